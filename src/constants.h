@@ -3,6 +3,8 @@
 const int SCREEN_WIDTH = 384;
 const int SCREEN_HEIGHT = 216;
 
-const int DESIRED_FPS = 24;
-const int MILLISECONDS_PER_FRAME = 1000 / DESIRED_FPS;
+// Default simulation rate in fixed timestep mode
+const int TICKS_PER_SECOND = 60;
+
+// Maximum number of simulation ticks run to catch up in a single frame
 const int MAX_FRAMESKIP = 5;
@@ -1,5 +1,6 @@
 #include "controls.h"
 
+#include <set>
 #include <unordered_map>
 
 namespace controls {
@@ -11,6 +12,8 @@ std::vector<sf::Keyboard::Key> jumpKeys;
 std::vector<sf::Keyboard::Key> actionKeys;
 std::vector<sf::Keyboard::Key> attackKeys;
 
+std::set<sf::Keyboard::Key> pressedKeys;
+
 void init() {
   directionKeys[util::Direction::UP] = {sf::Keyboard::Up, sf::Keyboard::W};
   directionKeys[util::Direction::DOWN] = {sf::Keyboard::Down, sf::Keyboard::S};
@@ -23,6 +26,21 @@ void init() {
   attackKeys = {sf::Keyboard::C};
 }
 
+void handleEvent(const sf::Event& event) {
+  if (event.type == sf::Event::KeyPressed) {
+    pressedKeys.insert(event.key.code);
+  } else if (event.type == sf::Event::KeyReleased) {
+    pressedKeys.erase(event.key.code);
+  } else if (event.type == sf::Event::LostFocus) {
+    // Releases won't be delivered while unfocused
+    pressedKeys.clear();
+  }
+}
+
+bool keyPressed(const sf::Keyboard::Key key) {
+  return pressedKeys.find(key) != pressedKeys.end();
+}
+
 void setDirectionKeys(const util::Direction direction,
                       const std::vector<sf::Keyboard::Key>& keys) {
   directionKeys[direction].clear();
@@ -31,7 +49,7 @@ void setDirectionKeys(const util::Direction direction,
 
 bool anyKeyPressed(const std::vector<sf::Keyboard::Key>& keys) {
   for (const auto& key : keys) {
-    if (sf::Keyboard::isKeyPressed(key)) {
+    if (keyPressed(key)) {
       return true;
     }
   }
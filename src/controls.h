@@ -8,6 +8,23 @@ namespace controls {
 
 void init();
 
+/**
+ * Tracks key state from window events. Key state is kept from events
+ * rather than polled from the keyboard so it works without a window and
+ * only changes when the engine feeds it input.
+ *
+ * @param event Event to track
+ */
+void handleEvent(const sf::Event& event);
+
+/**
+ * Checks whether a key is currently held down
+ *
+ * @param key Key to check
+ * @return Whether the key is held down
+ */
+bool keyPressed(const sf::Keyboard::Key key);
+
 void setDirectionKeys(const util::Direction direction,
                       const std::vector<sf::Keyboard::Key>& keys);
 
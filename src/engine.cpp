@@ -3,17 +3,60 @@
 #include "constants.h"
 #include "controls.h"
 #include "log.h"
+#include "profiler.h"
+#include "render_snapshot.h"
+#include "replay.h"
 #include "state.h"
 #include "util.h"
+#include "visual/profiler_overlay.h"
 
 #include <SFML/Graphics.hpp>
 
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
 namespace Engine {
 std::stack<std::unique_ptr<Screen>> screens;
 
-sf::RenderWindow window;
+// Created in init() rather than at startup since constructing any SFML
+// graphics resource opens a display, which headless runs don't have
+std::unique_ptr<sf::RenderWindow> window;
+
+// Written by the simulation thread and read by the render thread when
+// running threaded
+std::atomic<bool> running_(true);
+
+bool headless_ = false;
+
+// Toggles the profiler overlay
+const sf::Keyboard::Key PROFILER_KEY = sf::Keyboard::F3;
+
+bool fixedTimestep_ = true;
+sf::Time tickTime_ = sf::seconds(1.f / TICKS_PER_SECOND);
+
+bool threaded_ = false;
+
+// Total screen updates, used to report replay throughput
+util::Tick ticks_ = 0;
+
+// Snapshot handoff between the simulation and render threads. The
+// simulation fills back_ and publishes it by swapping it with ready_, and
+// the renderer picks up ready_ by swapping it with front_.
+std::unique_ptr<RenderSnapshot> front_;
+std::unique_ptr<RenderSnapshot> ready_;
+std::unique_ptr<RenderSnapshot> back_;
+bool fresh_ = false;
+std::mutex snapshotMutex_;
+std::condition_variable snapshotConsumed_;
 
-bool running_ = true;
+// Events polled by the render thread, waiting for the simulation thread
+std::vector<sf::Event> pendingEvents_;
+std::mutex eventMutex_;
 
 bool init() {
   sf::VideoMode desktop = sf::VideoMode::getDesktopMode();
@@ -25,73 +68,378 @@ bool init() {
 
   logger::info("Screen scale ratio: " + std::to_string(scale));
 
-  window.create(sf::VideoMode(SCREEN_WIDTH * scale, SCREEN_HEIGHT * scale),
-                "Portland");
+  window = std::make_unique<sf::RenderWindow>(
+      sf::VideoMode(SCREEN_WIDTH * scale, SCREEN_HEIGHT * scale), "Portland");
 
-  window.setFramerateLimit(60);
-  window.setVerticalSyncEnabled(true);
+  window->setFramerateLimit(60);
+  window->setVerticalSyncEnabled(true);
 
   GameState::initApi();
 
   controls::init();
 
+  visual::ProfilerOverlay::initialize();
+
   logger::info("Game initialized");
 
   return true;
 }
 
-void run() {
+bool initHeadless() {
+  headless_ = true;
+
+  GameState::initApi();
+
+  controls::init();
+
+  logger::info("Game initialized (headless)");
+
+  return true;
+}
+
+bool headless() { return headless_; }
+
+void setFixedTimestep(bool enabled) { fixedTimestep_ = enabled; }
+
+void setThreaded(bool enabled) { threaded_ = enabled; }
+
+void setTickRate(int ticksPerSecond) {
+  if (ticksPerSecond <= 0) {
+    logger::warning("Ignoring invalid tick rate: " +
+                    std::to_string(ticksPerSecond));
+    return;
+  }
+  tickTime_ = sf::seconds(1.f / ticksPerSecond);
+  logger::info("Tick rate: " + std::to_string(ticksPerSecond));
+}
+
+int tickRate() { return (int)std::lround(1.f / tickTime_.asSeconds()); }
+
+/**
+ * Advances the topmost screen by the given frame time. In fixed timestep
+ * mode the time is banked in the accumulator and spent in whole ticks,
+ * running at most MAX_FRAMESKIP ticks per frame.
+ *
+ * @param elapsed Time since last frame
+ * @param accumulator Simulation time not yet spent on ticks
+ * @return Interpolation factor between the last two ticks
+ */
+static float step(sf::Time elapsed, sf::Time& accumulator) {
+  if (!fixedTimestep_) {
+    running_ = screens.top()->update(elapsed);
+    ++ticks_;
+    return 1.f;
+  }
+
+  accumulator += elapsed;
+
+  int steps = 0;
+  while (accumulator >= tickTime_ && steps < MAX_FRAMESKIP && running_) {
+    sf::Time tick = tickTime_;
+    running_ = screens.top()->update(tick);
+    ++ticks_;
+    accumulator -= tickTime_;
+    ++steps;
+  }
+
+  // Drop whatever we could not catch up on so one slow frame doesn't
+  // snowball into every following frame running MAX_FRAMESKIP ticks
+  if (accumulator >= tickTime_) {
+    accumulator %= tickTime_;
+  }
+
+  return accumulator / tickTime_;
+}
+
+/**
+ * Polls window events, handling the ones that belong to the window itself
+ *
+ * @param events List to append events for the game to
+ * @return Whether the window is still open
+ */
+static bool pollEvents(std::vector<sf::Event>& events) {
+  sf::Event event;
+  while (window->pollEvent(event)) {
+    if (event.type == sf::Event::Closed) {
+      window->close();
+      return false;
+    } else if (event.type == sf::Event::Resized) {
+      const auto windowSize = window->getSize();
+      window->setView(sf::View(
+          sf::FloatRect(0.f, 0.f, (float)windowSize.x, (float)windowSize.y)));
+    } else if (event.type == sf::Event::KeyPressed &&
+               event.key.code == PROFILER_KEY) {
+      visual::ProfilerOverlay::toggle();
+      continue;
+    }
+
+    events.push_back(event);
+  }
+  return true;
+}
+
+/**
+ * Passes polled events to the controls and the topmost screen
+ *
+ * @param events Events to dispatch
+ */
+static void dispatchEvents(std::vector<sf::Event>& events) {
+  profiler::ScopedTimer timer(profiler::Phase::EVENTS);
+  for (auto& event : events) {
+    controls::handleEvent(event);
+    screens.top()->handleEvent(event);
+  }
+}
+
+/**
+ * Feeds one frame of input to the screens. This is the only way input
+ * reaches the simulation, so it's where frames are recorded and where
+ * recorded frames replace live input.
+ *
+ * @param events Events polled this frame, replaced when replaying
+ * @param elapsed Time since last frame
+ * @param accumulator Simulation time not yet spent on ticks
+ * @return Interpolation factor between the last two ticks
+ */
+static float advance(std::vector<sf::Event>& events, sf::Time elapsed,
+                     sf::Time& accumulator) {
+  if (replay::replaying()) {
+    if (!replay::nextFrame(elapsed, events)) {
+      logger::info("Replay finished");
+      running_ = false;
+      return 1.f;
+    }
+  } else if (replay::recording()) {
+    replay::recordFrame(elapsed, events);
+  }
+
+  dispatchEvents(events);
+  events.clear();
+
+  return step(elapsed, accumulator);
+}
+
+/**
+ * Finishes the frame in target and presents it scaled to the window
+ *
+ * @param target Rendered frame
+ */
+static void present(sf::RenderTexture& target) {
+  if (visual::ProfilerOverlay::visible()) {
+    visual::ProfilerOverlay::render(target);
+  }
+  target.display();
+
+  {
+    profiler::ScopedTimer timer(profiler::Phase::UPSCALE);
+
+    auto windowSize = window->getSize();
+
+    sf::Sprite rendered(target.getTexture());
+    rendered.setOrigin(SCREEN_WIDTH / 2, SCREEN_HEIGHT / 2);
+    rendered.setPosition((float)windowSize.x / 2, (float)windowSize.y / 2);
+
+    float scale = std::min(1.0f * windowSize.y / SCREEN_HEIGHT,
+                           1.0f * windowSize.x / SCREEN_WIDTH);
+
+    rendered.setScale(scale, scale);
+
+    window->clear(sf::Color::Black);
+    window->draw(rendered);
+  }
+
+  {
+    profiler::ScopedTimer timer(profiler::Phase::PRESENT);
+    window->display();
+  }
+}
+
+/**
+ * Simulation side of a threaded run. Updates the screens and publishes a
+ * snapshot of the topmost one, staying at most one snapshot ahead of the
+ * renderer so input latency doesn't grow.
+ */
+static void simulate() {
   sf::Clock clock;
+  sf::Time accumulator;
+  std::vector<sf::Event> events;
+
+  while (running_) {
+    {
+      std::lock_guard<std::mutex> lock(eventMutex_);
+      events.swap(pendingEvents_);
+    }
+    const float interpolation = advance(events, clock.restart(), accumulator);
+    if (!running_) {
+      break;
+    }
+
+    back_->clear();
+    if (!screens.top()->snapshot(*back_, interpolation)) {
+      back_->prerender(*screens.top(), interpolation);
+    }
+
+    std::unique_lock<std::mutex> lock(snapshotMutex_);
+    std::swap(back_, ready_);
+    fresh_ = true;
+    snapshotConsumed_.wait(lock, [] { return !fresh_ || !running_; });
+  }
+}
+
+/**
+ * Runs the simulation on its own thread while this thread draws the latest
+ * snapshot it produced
+ *
+ * @param target Target to render frames to before upscaling
+ */
+static void runThreaded(sf::RenderTexture& target) {
+  front_ = std::make_unique<RenderSnapshot>();
+  ready_ = std::make_unique<RenderSnapshot>();
+  back_ = std::make_unique<RenderSnapshot>();
+
+  std::exception_ptr error;
+  std::thread simulation([&error] {
+    try {
+      simulate();
+    } catch (...) {
+      error = std::current_exception();
+      running_ = false;
+    }
+  });
+
+  std::vector<sf::Event> events;
+  while (window->isOpen() && running_) {
+    profiler::beginFrame();
+
+    {
+      profiler::ScopedTimer timer(profiler::Phase::EVENTS);
+      if (!pollEvents(events)) {
+        break;
+      }
+      std::lock_guard<std::mutex> lock(eventMutex_);
+      pendingEvents_.insert(pendingEvents_.end(), events.begin(),
+                            events.end());
+      events.clear();
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(snapshotMutex_);
+      if (fresh_) {
+        std::swap(front_, ready_);
+        fresh_ = false;
+      }
+    }
+    snapshotConsumed_.notify_one();
+
+    target.clear(sf::Color::Black);
+    front_->render(target);
+    present(target);
+
+    profiler::endFrame();
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(snapshotMutex_);
+    running_ = false;
+  }
+  snapshotConsumed_.notify_one();
+  simulation.join();
+
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
 
+void run() {
   sf::RenderTexture target;
   target.create(SCREEN_WIDTH, SCREEN_HEIGHT);
 
 #ifdef __APPLE__
   // See SFML bug #1132
-  window.display();
+  window->display();
 #endif
 
-  while (window.isOpen() && running_) {
+  if (threaded_) {
+    logger::info("Running simulation on its own thread");
+    runThreaded(target);
+    return;
+  }
+
+  sf::Clock clock;
+  sf::Time accumulator;
+  std::vector<sf::Event> events;
+
+  while (window->isOpen() && running_) {
+    profiler::beginFrame();
+
     sf::Time elapsed = clock.restart();
 
-    sf::Event event;
-    while (window.pollEvent(event)) {
-      if (event.type == sf::Event::Closed) {
-        window.close();
+    {
+      profiler::ScopedTimer timer(profiler::Phase::EVENTS);
+      if (!pollEvents(events)) {
         return;
-      } else if (event.type == sf::Event::Resized) {
-        const auto windowSize = window.getSize();
-        window.setView(sf::View(
-            sf::FloatRect(0.f, 0.f, (float)windowSize.x, (float)windowSize.y)));
       }
-
-      screens.top()->handleEvent(event);
     }
 
-    running_ = screens.top()->update(elapsed);
-
-    auto windowSize = window.getSize();
+    const float interpolation = advance(events, elapsed, accumulator);
+    if (!running_) {
+      return;
+    }
 
     target.clear(sf::Color::Black);
-    screens.top()->render(target);
-    target.display();
+    screens.top()->render(target, interpolation);
+    present(target);
 
-    sf::Sprite rendered(target.getTexture());
-    rendered.setOrigin(SCREEN_WIDTH / 2, SCREEN_HEIGHT / 2);
-    rendered.setPosition((float)windowSize.x / 2, (float)windowSize.y / 2);
+    profiler::endFrame();
+  }
+}
 
-    float scale = std::min(1.0f * windowSize.y / SCREEN_HEIGHT,
-                           1.0f * windowSize.x / SCREEN_WIDTH);
+util::Tick runReplay() {
+  const util::Tick start = ticks_;
+  sf::Time accumulator;
+  std::vector<sf::Event> events;
+  while (running_ && replay::replaying()) {
+    profiler::beginFrame();
+    advance(events, sf::Time::Zero, accumulator);
+    profiler::endFrame();
+  }
+  return ticks_ - start;
+}
 
-    rendered.setScale(scale, scale);
+bool startRecording(const std::string& path) {
+  replay::Header header;
+  header.seed = GameState::randomSeed();
+  header.tickTime = tickTime_;
+  header.fixedTimestep = fixedTimestep_;
+  return replay::startRecording(path, header);
+}
 
-    window.clear(sf::Color::Black);
-    window.draw(rendered);
-    window.display();
+bool startReplay(const std::string& path) {
+  replay::Header header;
+  if (!replay::startReplay(path, header)) {
+    return false;
   }
+  GameState::seedRandom(header.seed);
+  tickTime_ = header.tickTime;
+  fixedTimestep_ = header.fixedTimestep;
+  return true;
+}
+
+util::Tick runHeadless(const util::Tick ticks) {
+  util::Tick ran = 0;
+  while (ran < ticks && running_) {
+    profiler::beginFrame();
+    sf::Time tick = tickTime_;
+    running_ = screens.top()->update(tick);
+    ++ran;
+    profiler::endFrame();
+  }
+  return ran;
 }
 
 void cleanup() {
+  replay::stop();
+
   while (!screens.empty()) {
     popScreen();
   }
@@ -1,14 +1,101 @@
 #pragma once
 
 #include "screens/screen.h"
+#include "util.h"
 
 #include <memory>
+#include <string>
 
 namespace Engine {
 bool init();
 void run();
 void cleanup();
 
+/**
+ * Initializes the engine without a window. Screens can be updated with
+ * runHeadless() but never render, and nothing is loaded onto the GPU.
+ *
+ * @return Whether the operation was successful
+ */
+bool initHeadless();
+
+/**
+ * Gets whether the engine was initialized without a window
+ *
+ * @return Whether the engine is headless
+ */
+bool headless();
+
+/**
+ * Updates the topmost screen for the given number of ticks as fast as
+ * possible, without polling events or rendering
+ *
+ * @param ticks Number of ticks to run
+ * @return Number of ticks run before the screen stopped
+ */
+util::Tick runHeadless(const util::Tick ticks);
+
+/**
+ * Records the input fed to the screens, along with the settings needed to
+ * play it back, until cleanup(). Must be called before the first screen is
+ * created so the random seed is captured before anything uses it.
+ *
+ * @param path File to record to
+ * @return Whether the operation was successful
+ */
+bool startRecording(const std::string& path);
+
+/**
+ * Replaces live input with a recording, applying the random seed, tick rate
+ * and timestep mode it was recorded with. The engine stops when the
+ * recording runs out. Must be called before the first screen is created.
+ *
+ * @param path Recording to play back
+ * @return Whether the operation was successful
+ */
+bool startReplay(const std::string& path);
+
+/**
+ * Plays back the current recording without a window as fast as possible.
+ * Recorded frame times still decide how many ticks each frame runs.
+ *
+ * @return Number of ticks run
+ */
+util::Tick runReplay();
+
+/**
+ * Enables or disables fixed timestep simulation. When enabled, screens are
+ * updated at a constant tick rate and rendered with an interpolation factor
+ * between the last two ticks. When disabled, screens are updated once per
+ * frame with the raw frame time.
+ *
+ * @param enabled Whether to use a fixed timestep
+ */
+void setFixedTimestep(bool enabled);
+
+/**
+ * Sets the simulation rate used in fixed timestep mode
+ *
+ * @param ticksPerSecond Number of simulation ticks per second
+ */
+void setTickRate(int ticksPerSecond);
+
+/**
+ * Gets the simulation rate used in fixed timestep mode
+ *
+ * @return Number of simulation ticks per second
+ */
+int tickRate();
+
+/**
+ * Enables or disables running the simulation on its own thread. When
+ * enabled, screens are updated on a separate thread that hands the render
+ * thread a snapshot of what to draw after each update.
+ *
+ * @param enabled Whether to update and render on separate threads
+ */
+void setThreaded(bool enabled);
+
 /**
  * Adds a new screen on top of the stack
  *
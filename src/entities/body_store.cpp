@@ -0,0 +1,51 @@
+#include "body_store.h"
+
+namespace entities {
+
+Body BodyStore::allocate() {
+  Body body;
+  if (!free.empty()) {
+    body = free.back();
+    free.pop_back();
+  } else {
+    body = (Body)flags.size();
+    left.emplace_back();
+    top.emplace_back();
+    width.emplace_back();
+    height.emplace_back();
+    lastLeft.emplace_back();
+    lastTop.emplace_back();
+    velocityY.emplace_back();
+    flags.emplace_back();
+    frame.emplace_back();
+    frameTime.emplace_back();
+  }
+
+  left[body] = top[body] = width[body] = height[body] = 0;
+  lastLeft[body] = lastTop[body] = 0;
+  velocityY[body] = 0;
+  flags[body] = BODY_LIVE;
+  frame[body] = 0;
+  frameTime[body] = sf::Time::Zero;
+  return body;
+}
+
+void BodyStore::release(const Body body) {
+  flags[body] = 0;
+  free.push_back(body);
+}
+
+void BodyStore::storePositions() {
+  const std::size_t count = flags.size();
+  for (std::size_t i = 0; i < count; i++) {
+    lastLeft[i] = left[i];
+    lastTop[i] = top[i];
+  }
+  for (std::size_t i = 0; i < count; i++) {
+    if (flags[i] & BODY_LIVE) {
+      flags[i] |= BODY_HAS_LAST_POSITION;
+    }
+  }
+}
+
+}  // namespace entities
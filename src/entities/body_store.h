@@ -0,0 +1,103 @@
+#pragma once
+
+#include <SFML/Graphics.hpp>
+
+#include <cstdint>
+#include <vector>
+
+namespace entities {
+
+// Index of a body in the store
+typedef std::uint32_t Body;
+
+// Vertical velocity gained by falling bodies each tick
+const float GRAVITY = .5;
+
+enum BodyFlag : std::uint8_t {
+  // Body belongs to a sprite
+  BODY_LIVE = 1 << 0,
+  // Sprite is updated, rendered, etc
+  BODY_ACTIVE = 1 << 1,
+  // Sprite can occupy the same space as other sprites
+  BODY_PHASED = 1 << 2,
+  BODY_JUMPING = 1 << 3,
+  BODY_CAN_JUMP = 1 << 4,
+  // Last position holds the position at the start of the tick
+  BODY_HAS_LAST_POSITION = 1 << 5,
+};
+
+/**
+ * Per-sprite state that is read or written every tick, kept as parallel
+ * arrays indexed by body so that passes over every sprite walk memory in
+ * order. Sprites own a body for as long as they live and reach their state
+ * through it.
+ *
+ * Released bodies are reused, so the arrays only grow to the most sprites
+ * alive at once.
+ */
+struct BodyStore {
+  // Bounds after scaling
+  std::vector<float> left;
+  std::vector<float> top;
+  std::vector<float> width;
+  std::vector<float> height;
+
+  // Position at the start of the current tick, used to interpolate renders
+  std::vector<float> lastLeft;
+  std::vector<float> lastTop;
+
+  std::vector<float> velocityY;
+  std::vector<std::uint8_t> flags;
+
+  // Current animation frame and time spent on it
+  std::vector<int> frame;
+  std::vector<sf::Time> frameTime;
+
+  std::vector<Body> free;
+
+  /**
+   * Gets a body for a new sprite, with every value zeroed
+   *
+   * @return New body
+   */
+  Body allocate();
+
+  /**
+   * Gives a body back once its sprite is destroyed
+   *
+   * @param body Body to release
+   */
+  void release(Body body);
+
+  /**
+   * Remembers the position of every body as the start of the tick
+   */
+  void storePositions();
+
+  bool has(const Body body, const std::uint8_t flag) const {
+    return (flags[body] & flag) != 0;
+  }
+
+  void set(const Body body, const std::uint8_t flag, const bool value) {
+    if (value) {
+      flags[body] |= flag;
+    } else {
+      flags[body] &= ~flag;
+    }
+  }
+};
+
+/**
+ * Gets the store holding every sprite's body
+ *
+ * Intentionally leaked so sprites held by namespace-scope statics can still
+ * release their bodies while being destroyed at exit
+ *
+ * @return Body store
+ */
+inline BodyStore& bodies() {
+  static BodyStore* store = new BodyStore;
+  return *store;
+}
+
+}  // namespace entities
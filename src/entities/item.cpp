@@ -7,6 +7,11 @@
 
 namespace entities {
 
+void Item::reset(const std::shared_ptr<const SpritePrototype>& prototype) {
+  Sprite::reset(prototype);
+  held_ = false;
+}
+
 void Item::update(const sf::Time& time) { Sprite::update(time); }
 
 }  // namespace entities
@@ -29,7 +29,10 @@ class Item : public Sprite {
  public:
   Item(const std::string& path) : Sprite(path, SpriteType::ITEM) {}
 
-  bool phased() { return true; }
+  Item(const std::shared_ptr<const SpritePrototype>& prototype)
+      : Sprite(prototype, SpriteType::ITEM) {}
+
+  void reset(const std::shared_ptr<const SpritePrototype>& prototype);
 
   void drop() {
     held_ = false;
@@ -10,8 +10,9 @@ void Npc::update(const sf::Time&) {
   }
 }
 
-void Npc::render(sf::RenderTarget& window, sf::Vector2f cameraPos) {
-  Sprite::render(window, cameraPos);
+void Npc::render(sf::RenderTarget& window, sf::Vector2f cameraPos,
+                 float interpolation) {
+  Sprite::render(window, cameraPos, interpolation);
 }
 
 }  // namespace entities
@@ -16,11 +16,13 @@ class Npc : public Sprite {
  public:
   Npc(const std::string& path) : Sprite(path, entities::SpriteType::NPC) {}
 
-  bool phased() { return false; }
+  Npc(const std::shared_ptr<const SpritePrototype>& prototype)
+      : Sprite(prototype, entities::SpriteType::NPC) {}
 
   void update(const sf::Time& time);
 
-  void render(sf::RenderTarget& window, sf::Vector2f cameraPos);
+  void render(sf::RenderTarget& window, sf::Vector2f cameraPos,
+              float interpolation);
 };
 
 }  // namespace entities
@@ -1,15 +1,28 @@
 #include "projectile.h"
 
+#include "../state.h"
+
 #include <cmath>
 
 namespace entities {
 
+void Projectile::reset(
+    const std::shared_ptr<const SpritePrototype>& prototype) {
+  Sprite::reset(prototype);
+  speed_ = 1;
+  moved_ = 0;
+  maxDistance_ = 0;
+}
+
 void Projectile::update(const sf::Time& time) {
   Sprite::update(time);
 
-  move(speed_, 0);
-  moved_ += std::fabs(speed_);
-  if (moved_ > maxDistance_) {
+  // Projectiles break on the first dense tile in their way
+  const auto sweep = GameState::map()->sweep(getDimensions(),
+                                             sf::Vector2f(speed_, 0));
+  move(speed_ * sweep.time, 0);
+  moved_ += std::fabs(speed_ * sweep.time);
+  if (sweep.normal.x != 0 || moved_ > maxDistance_) {
     markNeedsCleanup();
   }
 }
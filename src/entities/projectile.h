@@ -32,13 +32,17 @@ class Projectile : public Sprite {
  public:
   Projectile(const std::string& path) : Sprite(path, SpriteType::PROJECTILE) {}
 
+  Projectile(const std::shared_ptr<const SpritePrototype>& prototype)
+      : Sprite(prototype, SpriteType::PROJECTILE) {}
+
+  void reset(const std::shared_ptr<const SpritePrototype>& prototype);
+
   void setSpeed(const float speed) { speed_ = speed; }
   void setMaxDistance(const float maxDistance) { maxDistance_ = maxDistance; }
 
-  bool phased() { return true; }
-
   /**
-   * Animates item
+   * Animates and moves projectile, cleaning it up once it hits a dense
+   * tile or flies its maximum distance
    *
    * @param time Amount of time since last update
    */
@@ -1,84 +1,146 @@
 #include "sprite.h"
 
-#include <fstream>
+#include "../engine.h"
+#include "../resources.h"
+#include "../vfs.h"
+
 #include <iostream>
-#include <sstream>
 #include <vector>
 
 namespace entities {
 
-Sprite::Sprite(const std::string& path, SpriteType type)
-    : path_(path), type_(type) {
-  load(path);
+// Prototypes by the path they were loaded from. Held weakly like the
+// resource cache, so a prototype and its textures are freed with the last
+// sprite using them.
+std::unordered_map<std::string, std::weak_ptr<const SpritePrototype>>
+    prototypes_;
 
-  direction_ = util::Direction::RIGHT;
-  visualDirection_ = util::Direction::RIGHT;
-}
-
-bool Sprite::load(const std::string& path) {
-  std::ifstream spritefile(path);
-
-  if (!spritefile.is_open()) {
+/**
+ * Reads and parses a sprite definition
+ *
+ * @param path Path of sprite definition
+ * @param prototype Prototype to fill
+ * @return Whether the operation was successful
+ */
+static bool loadPrototype(const std::string& path,
+                          SpritePrototype& prototype) {
+  std::string fileData;
+  if (!vfs::readFile(path, fileData)) {
     logger::error("Unable to load spritefile: " + path);
     return false;
   }
 
-  std::stringstream fileData;
-  fileData << spritefile.rdbuf();
-  spritefile.close();
-
-  auto spriteData = nlohmann::json::parse(fileData.str());
+  auto spriteData = nlohmann::json::parse(fileData);
 
-  dimensions_.width = spriteData["width"].get<float>();
-  dimensions_.height = spriteData["height"].get<float>();
-  tile_ = spriteData["tile"].get<map::TileId>();
-  updateMs_ = sf::milliseconds(spriteData["update_ms"].get<int>());
-  multiFile_ = spriteData["multi_file"].get<bool>();
-  scale_ = spriteData["scale"].get<float>();
-  sprite_.setScale(scale_, scale_);
-  frameSpacing_ = spriteData["frame_spacing"].get<int>();
-  columns_ = spriteData["columns"].get<int>();
+  prototype.width = spriteData["width"].get<float>();
+  prototype.height = spriteData["height"].get<float>();
+  prototype.tile = spriteData["tile"].get<map::TileId>();
+  prototype.updateMs = sf::milliseconds(spriteData["update_ms"].get<int>());
+  prototype.multiFile = spriteData["multi_file"].get<bool>();
+  prototype.scale = spriteData["scale"].get<float>();
+  prototype.frameSpacing = spriteData["frame_spacing"].get<int>();
+  prototype.columns = spriteData["columns"].get<int>();
 
   std::vector<std::string> texturePaths;
-  if (multiFile_) {
+  if (prototype.multiFile) {
     texturePaths = spriteData["frames"].get<std::vector<std::string>>();
-    totalFrames_ = (int)texturePaths.size();
+    prototype.totalFrames = (int)texturePaths.size();
   } else {
     texturePaths.push_back(spriteData["texture"].get<std::string>());
-    totalFrames_ = spriteData["total_frames"].get<int>();
+    prototype.totalFrames = spriteData["total_frames"].get<int>();
+  }
+
+  // Headless runs never render, so don't touch the GPU
+  if (Engine::headless()) {
+    return true;
   }
 
   auto basePath = path.substr(0, path.find_last_of("/"));
   for (auto& path : texturePaths) {
-    std::string fullPath = basePath + "/" + path;
-    sf::Texture texture;
-    texture.loadFromFile(fullPath);
-
-    textures_.push_back(texture);
+    prototype.textures.push_back(resources::texture(basePath + "/" + path));
   }
 
   return true;
 }
 
-void Sprite::updateVelocity() {
-  velocityY_ += GRAVITY;
+std::shared_ptr<const SpritePrototype> prototype(const std::string& path) {
+  auto& entry = prototypes_[path];
+  auto cached = entry.lock();
+  if (cached) {
+    return cached;
+  }
 
-  // Necessary to prevent jumping after initiating a fall
-  jumping_ = true;
+  auto loaded = std::make_shared<SpritePrototype>();
+  if (!loadPrototype(path, *loaded)) {
+    *loaded = SpritePrototype();
+  }
+  loaded->path = path;
+  entry = loaded;
+  return loaded;
 }
 
-void Sprite::setVelocity(float velocity) { velocityY_ = velocity; }
+/**
+ * Whether sprites of a type can occupy the same space as other sprites
+ *
+ * @param type Sprite type
+ * @return Whether sprites of the type are phased
+ */
+static bool phasedType(const SpriteType type) {
+  return type == SpriteType::ITEM || type == SpriteType::PROJECTILE;
+}
 
-void Sprite::startJump(float magnitudePercent) {
-  if (!jumping_ && canJump_) {
-    velocityY_ = STARTING_JUMP_VELOCITY * magnitudePercent;
-    jumping_ = true;
-  }
+Sprite::Sprite(const std::shared_ptr<const SpritePrototype>& prototype,
+               SpriteType type)
+    : type_(type), body_(bodies().allocate()) {
+  reset(prototype);
 }
 
-void Sprite::zeroVelocity(bool stopJump) {
-  velocityY_ = 0;
-  jumping_ = !stopJump;
+void Sprite::reset(const std::shared_ptr<const SpritePrototype>& prototype) {
+  prototype_ = prototype;
+
+  auto& store = bodies();
+  store.left[body_] = 0;
+  store.top[body_] = 0;
+  store.width[body_] = prototype_->width * prototype_->scale;
+  store.height[body_] = prototype_->height * prototype_->scale;
+  store.velocityY[body_] = 0;
+  store.frame[body_] = 0;
+  store.frameTime[body_] = sf::Time::Zero;
+  store.flags[body_] = BODY_LIVE | BODY_ACTIVE | BODY_CAN_JUMP;
+  store.set(body_, BODY_PHASED, phasedType(type_));
+
+  tile_ = prototype_->tile;
+  sprite_.setScale(prototype_->scale, prototype_->scale);
+
+  hp_ = 0;
+  maxHp_ = 0;
+  needsCleanup_ = false;
+  heldItems_.clear();
+
+  direction_ = util::Direction::RIGHT;
+  visualDirection_ = util::Direction::RIGHT;
+
+  flags_.clear();
+  values_.clear();
+
+  callbackFunc = nullptr;
+  collisionFunc = nullptr;
+  collisionBeginFunc = nullptr;
+  collisionEndFunc = nullptr;
+  cleanupFunc = nullptr;
+  id = 0;
+}
+
+void Sprite::setVelocity(float velocity) {
+  bodies().velocityY[body_] = velocity;
+}
+
+void Sprite::startJump(float magnitudePercent) {
+  auto& store = bodies();
+  if (!store.has(body_, BODY_JUMPING) && store.has(body_, BODY_CAN_JUMP)) {
+    store.velocityY[body_] = STARTING_JUMP_VELOCITY * magnitudePercent;
+    store.set(body_, BODY_JUMPING, true);
+  }
 }
 
 void Sprite::setFlag(const std::string& key, const bool flag) {
@@ -109,13 +171,17 @@ const nlohmann::json Sprite::serialize() {
   nlohmann::json out;
 
   out["id"] = id;
-  out["path"] = path_;
+  out["path"] = prototype_->path;
   out["tile"] = tile_;
   out["type"] = static_cast<int>(type_);
-  out["dimensions"] = serializeFloatRect(dimensions_);
+  // Saved before scaling
+  auto dimensions = getDimensions();
+  dimensions.width /= prototype_->scale;
+  dimensions.height /= prototype_->scale;
+  out["dimensions"] = serializeFloatRect(dimensions);
   out["hp"] = hp_;
   out["max_hp"] = maxHp_;
-  out["active"] = active_;
+  out["active"] = active();
   out["held_items"] = heldItems_;
   out["flags"] = flags_;
   out["values"] = values_;
@@ -127,11 +193,15 @@ void Sprite::deserialize(const nlohmann::json& data) {
   id = data["id"].get<Id>();
   tile_ = data["tile"].get<map::TileId>();
   type_ = static_cast<SpriteType>(data["type"].get<int>());
-  dimensions_ = deserializeFloatRect(
+  bodies().set(body_, BODY_PHASED, phasedType(type_));
+  auto dimensions = deserializeFloatRect(
       data["dimensions"].get<std::unordered_map<std::string, float>>());
+  dimensions.width *= prototype_->scale;
+  dimensions.height *= prototype_->scale;
+  setDimensions(dimensions);
   hp_ = data["hp"].get<float>();
   maxHp_ = data["max_hp"].get<float>();
-  active_ = data["active"].get<bool>();
+  bodies().set(body_, BODY_ACTIVE, data["active"].get<bool>());
   heldItems_.clear();
   for (const auto itemId : data["held_items"].get<std::vector<Id>>()) {
     heldItems_.insert(itemId);
@@ -152,52 +222,82 @@ void Sprite::update(const sf::Time& time) {
   if (!active()) {
     return;
   }
-  time_ += time;
-  if (time_ >= updateMs_) {
-    int limit = textures_.size();
-    if (limit == 1 && totalFrames_ == 1) {
+  auto& store = bodies();
+  auto& frameTime = store.frameTime[body_];
+  frameTime += time;
+  if (frameTime >= prototype_->updateMs) {
+    int limit = prototype_->textures.size();
+    if (limit == 1 && prototype_->totalFrames == 1) {
       return;
     }
     int frameIncrease;
-    if (multiFile_) {
-      limit = totalFrames_;
+    if (prototype_->multiFile) {
+      limit = prototype_->totalFrames;
       frameIncrease = 1;
     } else {
-      limit = totalFrames_ * frameSpacing_;
-      frameIncrease = frameSpacing_;
+      limit = prototype_->totalFrames * prototype_->frameSpacing;
+      frameIncrease = prototype_->frameSpacing;
     }
-    frame_ = (frame_ + frameIncrease) % limit;
-    time_ = sf::seconds(0);
+    store.frame[body_] = (store.frame[body_] + frameIncrease) % limit;
+    frameTime = sf::seconds(0);
   }
 }
 
-void Sprite::render(sf::RenderTarget& window, sf::Vector2f cameraPos) {
-  if (!active()) {
-    return;
-  }
+const std::shared_ptr<const sf::Texture>& Sprite::frameSource(
+    sf::IntRect& source) {
+  const auto& store = bodies();
+  const int frame = store.frame[body_];
+  const int columns = prototype_->columns;
   map::TileId tile = tile_;
-  if (!multiFile_) {
-    tile += frame_;
+  if (!prototype_->multiFile) {
+    tile += frame;
   }
-  sf::IntRect source((tile % columns_) * (int)dimensions_.width,
-                     (tile / columns_) * (int)dimensions_.height,
-                     (int)dimensions_.width, (int)dimensions_.height);
 
-  sf::Texture tex;
-  if (multiFile_) {
-    tex = textures_[frame_];
-  } else {
-    tex = textures_[0];
-  }
-  sprite_.setTexture(tex);
+  // Frames are cut from the texture before scaling
+  const int width = (int)(store.width[body_] / prototype_->scale);
+  const int height = (int)(store.height[body_] / prototype_->scale);
+  source = sf::IntRect((tile % columns) * width, (tile / columns) * height,
+                       width, height);
+
   if (visualDirection_ == util::Direction::RIGHT) {
-    source.left += (int)dimensions_.width;
-    source.width = (int)-dimensions_.width;
+    source.left += width;
+    source.width = -width;
   }
+
+  if (prototype_->multiFile) {
+    return prototype_->textures[frame];
+  }
+  return prototype_->textures[0];
+}
+
+void Sprite::render(sf::RenderTarget& window, sf::Vector2f cameraPos,
+                    float interpolation) {
+  if (!active()) {
+    return;
+  }
+  sf::IntRect source;
+  const auto& texture = frameSource(source);
+  sprite_.setTexture(*texture);
   sprite_.setTextureRect(source);
-  sprite_.setPosition(dimensions_.left - cameraPos.x,
-                      dimensions_.top - cameraPos.y);
+  const auto position = interpolatedPosition(interpolation);
+  sprite_.setPosition(position.x - cameraPos.x, position.y - cameraPos.y);
   window.draw(sprite_);
 }
 
+void Sprite::snapshot(RenderSnapshot& snapshot, sf::Vector2f cameraPos,
+                      float interpolation) {
+  if (!active() || prototype_->textures.empty()) {
+    return;
+  }
+  sf::IntRect source;
+  const auto& texture = frameSource(source);
+  const auto position = interpolatedPosition(interpolation);
+
+  sf::Transform transform;
+  transform.translate(position.x - cameraPos.x, position.y - cameraPos.y)
+      .scale(prototype_->scale, prototype_->scale);
+
+  appendQuad(snapshot.quads(texture), transform, source);
+}
+
 }  // namespace entities
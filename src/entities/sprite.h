@@ -1,15 +1,21 @@
 #pragma once
 
+#include "../constants.h"
 #include "../log.h"
 #include "../map.h"
+#include "../render_snapshot.h"
+#include "../spatial_hash.h"
 #include "../util.h"
+#include "body_store.h"
 
 #include <SFML/Graphics.hpp>
 #include <json.hpp>
 
+#include <memory>
 #include <set>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 namespace entities {
 
@@ -24,53 +30,61 @@ enum class SpriteType : int {
   ITEM = 1,
   NPC = 2,
   PROJECTILE = 3,
+  COUNT,
 };
 
+/**
+ * Sprite definition, parsed once per path and shared by every sprite
+ * created from it
+ */
+struct SpritePrototype {
+  std::string path;
+  float width = 0;
+  float height = 0;
+  map::TileId tile = 0;
+  sf::Time updateMs;
+  bool multiFile = false;
+  float scale = 1;
+  int frameSpacing = 1;
+  int columns = 1;
+  int totalFrames = 1;
+
+  // Left empty in headless runs
+  std::vector<std::shared_ptr<const sf::Texture>> textures;
+};
+
+/**
+ * Gets the prototype for a sprite definition, reading and parsing it the
+ * first time the path is seen or after every sprite using it is gone.
+ * Definitions that fail to load get an empty prototype.
+ *
+ * @param path Path of sprite definition
+ * @return Shared prototype
+ */
+std::shared_ptr<const SpritePrototype> prototype(const std::string& path);
+
 /**
  * Class to load, render, and update sprites onscreen
  */
 class Sprite {
  protected:
-  const float GRAVITY = .5;
   const float STARTING_JUMP_VELOCITY = -7;
 
-  const std::string path_;
+  std::shared_ptr<const SpritePrototype> prototype_;
   SpriteType type_;
 
-  sf::FloatRect dimensions_;
-  int totalFrames_ = 0;
-  map::TileId tile_;
-  float scale_;
-  bool multiFile_;
-  int frameSpacing_;
-  int columns_;
-
-  sf::Time updateMs_;
+  // Holds position, size, velocity, flags and animation state
+  const Body body_;
 
-  int frame_ = 0;
+  map::TileId tile_;
 
   int hp_ = 0;
   int maxHp_ = 0;
 
-  bool canJump_ = true;
-  bool jumping_ = false;
-  float velocityY_ = 0;
-
-  // Whether or not this sprite is updated, rendered, etc
-  bool active_ = true;
   bool needsCleanup_ = false;
 
-  sf::Time time_;
-
   std::set<Id> heldItems_;
 
-  // Ticks at last frame transition
-  util::Tick lastTicks_ = 0;
-
-  const util::Tick FRAME_TICKS_INTERVAL = 24;
-
-  sf::FloatRect textureDimensions_;
-  std::vector<sf::Texture> textures_;
   sf::Sprite sprite_;
 
   util::Direction direction_;
@@ -79,13 +93,27 @@ class Sprite {
   std::unordered_map<std::string, bool> flags_;
   std::unordered_map<std::string, int> values_;
 
+  // Hash keeping the sprite's position, if any, and its handle there
+  SpatialHash<Sprite*>* spatialHash_ = nullptr;
+  SpatialHash<Sprite*>::Handle spatialHandle_ = -1;
+
+  /**
+   * Updates the sprite's position in its spatial hash after it moves
+   */
+  void moved() {
+    if (spatialHash_) {
+      spatialHash_->update(spatialHandle_, getDimensions());
+    }
+  }
+
   /**
-   * Loads sprite from given path
+   * Gets the texture and texture rectangle for the current frame
    *
-   * @param path Path to load sprite from
-   * @param Whether operation was successful
+   * @param source Set to the texture rectangle, negative sizes flip the
+   * sprite
+   * @return Texture for the current frame
    */
-  bool load(const std::string& path);
+  const std::shared_ptr<const sf::Texture>& frameSource(sf::IntRect& source);
 
   /**
    * Serializes a given FloatRect into a JSON blob
@@ -122,9 +150,14 @@ class Sprite {
   // API function to call when sprite is interacted with
   SpriteCallback callbackFunc;
 
-  // API function to call when sprite collides with another sprite
+  // API function to call once a tick while sprite touches another sprite
   CollisionCallback collisionFunc;
 
+  // API functions to call when sprite starts and stops touching another
+  // sprite
+  CollisionCallback collisionBeginFunc;
+  CollisionCallback collisionEndFunc;
+
   // API function to call when sprite is marked for cleanup
   CleanupCallback cleanupFunc;
 
@@ -132,22 +165,45 @@ class Sprite {
 
   Sprite(const std::string& path) : Sprite(path, SpriteType::HERO) {}
 
-  Sprite(const std::string& path, SpriteType type);
+  Sprite(const std::string& path, SpriteType type)
+      : Sprite(prototype(path), type) {}
+
+  Sprite(const std::shared_ptr<const SpritePrototype>& prototype,
+         SpriteType type);
+
+  Sprite(const Sprite&) = delete;
+  Sprite& operator=(const Sprite&) = delete;
+
+  virtual ~Sprite() { bodies().release(body_); }
 
   SpriteType type() { return type_; }
 
+  /**
+   * Returns the sprite to the state it was created in from a prototype so
+   * a pooled sprite can be reused
+   *
+   * @param prototype Prototype to take definition from
+   */
+  virtual void reset(const std::shared_ptr<const SpritePrototype>& prototype);
+
   /**
    * Gets dimensions of the sprite after scaling
    *
    * @return Scaled sprite dimensions
    */
   sf::FloatRect getDimensions() {
-    sf::FloatRect dim = dimensions_;
-    dim.width = dim.width * scale_;
-    dim.height = dim.height * scale_;
-    return dim;
+    const auto& store = bodies();
+    return sf::FloatRect(store.left[body_], store.top[body_],
+                         store.width[body_], store.height[body_]);
   }
 
+  /**
+   * Gets the sprite's body in the body store
+   *
+   * @return Body of sprite
+   */
+  Body body() { return body_; }
+
   /**
    * Gets the sprite's held items
    *
@@ -207,6 +263,24 @@ class Sprite {
     collisionFunc = func;
   }
 
+  /**
+   * Sets the callback for starting to touch another sprite
+   *
+   * @param New collision begin callback
+   */
+  void setCollisionBeginCallback(const CollisionCallback& func) {
+    collisionBeginFunc = func;
+  }
+
+  /**
+   * Sets the callback for no longer touching another sprite
+   *
+   * @param New collision end callback
+   */
+  void setCollisionEndCallback(const CollisionCallback& func) {
+    collisionEndFunc = func;
+  }
+
   /**
    * Sets the cleanup callback
    *
@@ -218,17 +292,17 @@ class Sprite {
    * Returns whether or not sprite is active
    * @return Whether or not sprite is active
    */
-  bool active() { return active_; }
+  bool active() { return bodies().has(body_, BODY_ACTIVE); }
 
   /**
    * Activates sprite (enables updates, renders, etc)
    */
-  void activate() { active_ = true; }
+  void activate() { bodies().set(body_, BODY_ACTIVE, true); }
 
   /**
    * Deactivates sprite (disables updates, renders, etc)
    */
-  void deactivate() { active_ = false; }
+  void deactivate() { bodies().set(body_, BODY_ACTIVE, false); }
 
   /**
    * Returns whether or not sprite needs to be cleaned up
@@ -247,15 +321,34 @@ class Sprite {
     }
   }
 
+  /**
+   * Keeps the sprite's position in a spatial hash, which is updated
+   * whenever the sprite moves, replacing any hash it was in
+   *
+   * @param hash Hash to keep position in, or nullptr to stop
+   */
+  void setSpatialHash(SpatialHash<Sprite*>* hash) {
+    if (spatialHash_) {
+      spatialHash_->remove(spatialHandle_);
+    }
+    spatialHash_ = hash;
+    if (spatialHash_) {
+      spatialHandle_ = spatialHash_->insert(this, getDimensions());
+    }
+  }
+
   /**
    * Sets dimensions of sprite after scaling
    *
    * @param dimensions New dimensions of sprite
    */
-  void setDimensions(sf::FloatRect dimensions) {
-    dimensions.width = dimensions.width / scale_;
-    dimensions.height = dimensions.height / scale_;
-    dimensions_ = dimensions;
+  void setDimensions(const sf::FloatRect& dimensions) {
+    auto& store = bodies();
+    store.left[body_] = dimensions.left;
+    store.top[body_] = dimensions.top;
+    store.width[body_] = dimensions.width;
+    store.height[body_] = dimensions.height;
+    moved();
   }
 
   /**
@@ -264,10 +357,8 @@ class Sprite {
    * @return Position of sprite
    */
   sf::Vector2f getPosition() {
-    sf::Vector2f position;
-    position.x = dimensions_.left;
-    position.y = dimensions_.top;
-    return position;
+    const auto& store = bodies();
+    return sf::Vector2f(store.left[body_], store.top[body_]);
   }
 
   /**
@@ -277,8 +368,42 @@ class Sprite {
    * @param y New y coordinate of sprite
    */
   void setPosition(const float x, const float y) {
-    dimensions_.left = x;
-    dimensions_.top = y;
+    auto& store = bodies();
+    store.left[body_] = x;
+    store.top[body_] = y;
+    moved();
+  }
+
+  /**
+   * Gets the render position between the position at the start of the tick
+   * and the current position
+   *
+   * @param interpolation Fraction of the way through the tick
+   * @return Interpolated position
+   */
+  sf::Vector2f interpolatedPosition(const float interpolation) {
+    const auto& store = bodies();
+    const auto position = getPosition();
+    if (!store.has(body_, BODY_HAS_LAST_POSITION)) {
+      return position;
+    }
+    const sf::Vector2f last(store.lastLeft[body_], store.lastTop[body_]);
+    return last + (position - last) * interpolation;
+  }
+
+  /**
+   * Checks whether the sprite's interpolated position overlaps the screen
+   *
+   * @param cameraPos Position of camera
+   * @param interpolation Fraction of the way through the tick
+   * @return Whether any of the sprite is on screen
+   */
+  bool onScreen(const sf::Vector2f cameraPos, const float interpolation) {
+    const auto position = interpolatedPosition(interpolation);
+    const sf::FloatRect bounds(position.x, position.y, width(), height());
+    return bounds.intersects(sf::FloatRect(cameraPos.x, cameraPos.y,
+                                           (float)SCREEN_WIDTH,
+                                           (float)SCREEN_HEIGHT));
   }
 
   /**
@@ -288,8 +413,10 @@ class Sprite {
    * @param dy Distance to move y coordinate
    */
   void move(const float dx, const float dy) {
-    dimensions_.left += dx;
-    dimensions_.top += dy;
+    auto& store = bodies();
+    store.left[body_] += dx;
+    store.top[body_] += dy;
+    moved();
   }
 
   /**
@@ -374,14 +501,14 @@ class Sprite {
    *
    * @return Scaled width of sprite
    */
-  float width() { return dimensions_.width * scale_; }
+  float width() { return bodies().width[body_]; }
 
   /**
    * Gets scaled height of sprite
    *
    * @return Scaled height of sprite
    */
-  float height() { return dimensions_.height * scale_; }
+  float height() { return bodies().height[body_]; }
 
   /**
    * Sets sprite's tile in spritesheet
@@ -395,12 +522,7 @@ class Sprite {
    *
    * @return Sprite's vertical velocity
    */
-  float velocity() { return velocityY_; }
-
-  /**
-   * Updates the vertical velocity with the gravity constant
-   */
-  void updateVelocity();
+  float velocity() { return bodies().velocityY[body_]; }
 
   /**
    * Updates the vertical velocity with the gravity constant
@@ -414,43 +536,36 @@ class Sprite {
    */
   void startJump(float magnitudePercent);
 
-  /**
-   * Clears out falling velocity
-   *
-   * @param stopJump Whether or not jump should stop
-   */
-  void zeroVelocity(bool stopJump);
-
   /**
    * Gets whether or not sprite is jumping
    *
    * @return Whether or not sprite is jumping
    */
-  bool jumping() { return jumping_; }
+  bool jumping() { return bodies().has(body_, BODY_JUMPING); }
 
   /**
    * Gets whether or not sprite can jump
    *
    * @return Whether or not sprite can jump
    */
-  bool canJump() { return canJump_; }
+  bool canJump() { return bodies().has(body_, BODY_CAN_JUMP); }
 
   /**
    * Allows sprite to jump
    */
-  void allowJump() { canJump_ = true; }
+  void allowJump() { bodies().set(body_, BODY_CAN_JUMP, true); }
 
   /**
    * Forbids player from jumping
    */
-  void forbidJump() { canJump_ = false; }
+  void forbidJump() { bodies().set(body_, BODY_CAN_JUMP, false); }
 
   /**
    * Whether or not this sprite can occupy the same space as another sprite
    *
    * @return Whether or not sprite can occupy the same space as another sprite
    */
-  virtual bool phased() { return false; }
+  bool phased() { return bodies().has(body_, BODY_PHASED); }
 
   /**
   * Set a sprite boolean value
@@ -511,8 +626,20 @@ class Sprite {
    * @param window Window to render to
    * @param cameraPos Position of camera to render sprite
    * relative to
+   * @param interpolation Fraction of time between regular updates
+   */
+  virtual void render(sf::RenderTarget& window, sf::Vector2f cameraPos,
+                      float interpolation);
+
+  /**
+   * Adds sprite relative to cameraPos to a render snapshot
+   *
+   * @param snapshot Snapshot to add to
+   * @param cameraPos Position of camera to render sprite relative to
+   * @param interpolation Fraction of time between regular updates
    */
-  virtual void render(sf::RenderTarget& window, sf::Vector2f cameraPos);
+  virtual void snapshot(RenderSnapshot& snapshot, sf::Vector2f cameraPos,
+                        float interpolation);
 };
 
 }  // namespace entities
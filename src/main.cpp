@@ -1,27 +1,86 @@
 #include "constants.h"
 #include "engine.h"
 #include "log.h"
+#include "map.h"
+#include "profiler.h"
 #include "util.h"
+#include "vfs.h"
 
+#include "screens/main_screen.h"
 #include "screens/opening.h"
 
-int main(int, char**) {
+#include <cstdlib>
+#include <string>
+
+int main(int argc, char** argv) {
   logger::init("portland.log");
 
+  std::string recordPath;
+  std::string replayPath;
+
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    if (arg == "--variable-timestep") {
+      Engine::setFixedTimestep(false);
+    } else if (arg == "--scroll-cache") {
+      map::setScrollCache(true);
+    } else if (arg == "--threaded") {
+      Engine::setThreaded(true);
+    } else if (arg == "--tick-rate" && i + 1 < argc) {
+      Engine::setTickRate(std::atoi(argv[++i]));
+    } else if (arg == "--record" && i + 1 < argc) {
+      recordPath = argv[++i];
+    } else if (arg == "--replay" && i + 1 < argc) {
+      replayPath = argv[++i];
+    } else if (arg == "--archive" && i + 1 < argc) {
+      // Before anything loads, so every asset comes from the archive
+      if (!vfs::mount(argv[++i])) {
+        return 1;
+      }
+    } else {
+      logger::warning("Unknown argument: " + arg);
+    }
+  }
+
+  // Replay and recording share one input stream per run
+  if (!recordPath.empty() && !replayPath.empty()) {
+    logger::error("--record and --replay can't be used together");
+    return 1;
+  }
+
   if (!Engine::init()) {
     logger::error("Error loading engine");
     Engine::cleanup();
     return 1;
   }
 
-  Engine::pushScreen(new OpeningScreen());
+  if (!replayPath.empty() && !Engine::startReplay(replayPath)) {
+    Engine::cleanup();
+    return 1;
+  }
+  if (!recordPath.empty() && !Engine::startRecording(recordPath)) {
+    Engine::cleanup();
+    return 1;
+  }
+
+  // Recordings start in game so they can also be replayed headless, which
+  // has no opening screen
+  if (recordPath.empty() && replayPath.empty()) {
+    Engine::pushScreen(new OpeningScreen());
+  } else {
+    Engine::pushScreen(new MainScreen());
+  }
 
   Engine::run();
 
   logger::info("Thanks for playing!");
 
+  profiler::dumpCsv("portland_profile.csv");
+
   Engine::cleanup();
 
+  vfs::unmount();
+
   logger::cleanup();
 
   return 0;
@@ -1,35 +1,40 @@
 #include "map.h"
 
+#include "constants.h"
 #include "log.h"
+#include "pmap.h"
 #include "util.h"
+#include "vfs.h"
 
-#include <fstream>
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 #include <limits>
-#include <sstream>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 namespace map {
 
+bool scrollCacheEnabled_ = false;
+
+void setScrollCache(bool enabled) { scrollCacheEnabled_ = enabled; }
+
+bool scrollCache() { return scrollCacheEnabled_; }
+
 Map::Map(const std::string& path) : path_(path) { load(path); }
 
-bool Map::load(const std::string& path) {
-  std::ifstream mapfile(path, std::ios::in);
-  if (!mapfile.is_open()) {
+bool Map::loadJson(const std::string& path) {
+  std::string fileData;
+  if (!vfs::readFile(path, fileData)) {
     logger::warning("Unable to open mapfile: " + path);
     return false;
   }
 
-  std::stringstream fileData;
-  fileData << mapfile.rdbuf();
-  mapfile.close();
-
   const auto mapBasePath = path.substr(0, path.find_last_of("/"));
-  const auto mapData = nlohmann::json::parse(fileData.str());
+  const auto mapData = nlohmann::json::parse(fileData);
 
-  const auto tilesets = mapData["tilesets"].get<std::vector<nlohmann::json>>();
-  for (const auto& tileset : tilesets) {
+  for (const auto& tileset : mapData["tilesets"]) {
     tilesets_.push_back(std::make_unique<Tileset>(mapBasePath, tileset));
   }
 
@@ -38,22 +43,250 @@ bool Map::load(const std::string& path) {
 
   tileWidth_ = mapData["tilewidth"].get<int>();
   tileHeight_ = mapData["tileheight"].get<int>();
+
+  const auto& layers = mapData["layers"];
+  layers_.reserve(layers.size());
+  for (const auto& layer : layers) {
+    layers_.emplace_back(layer);
+  }
+
+  return true;
+}
+
+bool Map::loadCompiled(const std::string& path) {
+  // Compiled maps in the archive are used in place, others are mapped
+  const char* data;
+  std::size_t size;
+  std::shared_ptr<MappedFile> file;
+  if (!vfs::find(path, data, size)) {
+    file = std::make_shared<MappedFile>();
+    if (!file->open(path)) {
+      logger::warning("Unable to open mapfile: " + path);
+      return false;
+    }
+    data = file->data();
+    size = file->size();
+  }
+
+  pmap::CompiledMap compiled;
+  if (!pmap::read(data, size, compiled)) {
+    logger::warning("Unable to read compiled map: " + path);
+    return false;
+  }
+
+  const auto mapBasePath = path.substr(0, path.find_last_of("/"));
+  for (const auto& tileset : compiled.tilesets) {
+    tilesets_.push_back(std::make_unique<Tileset>(mapBasePath, tileset));
+  }
+
+  mapWidth_ = compiled.width;
+  mapHeight_ = compiled.height;
+
+  tileWidth_ = compiled.tileWidth;
+  tileHeight_ = compiled.tileHeight;
+
+  layers_.reserve(compiled.layers.size());
+  for (const auto& layer : compiled.layers) {
+    layers_.emplace_back(mapWidth_, mapHeight_, layer.narrow, layer.plane);
+  }
+
+  // The layers read their tiles from the mapping
+  mappedFile_ = file;
+
+  return true;
+}
+
+bool Map::load(const std::string& path) {
+  const bool loaded =
+      pmap::isCompiledPath(path) ? loadCompiled(path) : loadJson(path);
+  if (!loaded) {
+    return false;
+  }
+
+  buildGidTable();
+
   mapPixelWidth_ = mapWidth_ * tileWidth_;
   mapPixelHeight_ = mapHeight_ * tileHeight_;
 
-  const auto layers = mapData["layers"].get<std::vector<nlohmann::json>>();
-  for (const auto& layer : layers) {
-    layers_.push_back(MapLayer(layer));
+  // Warn once here rather than on every lookup of a bad tile
+  std::size_t unknownTiles = 0;
+  for (const auto& layer : layers_) {
+    for (int i = 0; i < layer.height(); i++) {
+      for (int j = 0; j < layer.width(); j++) {
+        const auto tile = layer.tileAt(j, i);
+        if (tile != 0 && !tilesetForTile(tile)) {
+          ++unknownTiles;
+        }
+      }
+    }
+  }
+  if (unknownTiles > 0) {
+    logger::warning(path + " has " + std::to_string(unknownTiles) +
+                    " tiles without a tileset");
+  }
+
+  buildTopmost();
+  buildSolidity();
+
+  chunksWide_ = (mapWidth_ + CHUNK_TILES - 1) / CHUNK_TILES;
+  chunksHigh_ = (mapHeight_ + CHUNK_TILES - 1) / CHUNK_TILES;
+  chunks_.resize(layers_.size() * chunksWide_ * chunksHigh_);
+
+  uncachedCells_.resize((std::size_t)mapWidth_ * mapHeight_);
+  for (int i = 0; i < mapHeight_; i++) {
+    for (int j = 0; j < mapWidth_; j++) {
+      uncachedCells_[(std::size_t)i * mapWidth_ + j] = cellUncached(j, i);
+    }
+  }
+
+  blockedAbove_.resize((std::size_t)mapWidth_ * mapHeight_);
+  blockedBelow_.resize((std::size_t)mapWidth_ * mapHeight_);
+  for (int j = 0; j < mapWidth_; j++) {
+    buildColumn(j);
+  }
+
+  return true;
+}
+
+bool Map::cellBlocked(const int x, const int y) {
+  for (const auto& layer : layers_) {
+    const auto tile = layer.tileAt(x, y);
+    if (tile != 0 && !walkable(tile)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void Map::buildColumn(const int x) {
+  const std::size_t column = (std::size_t)x * mapHeight_;
+
+  std::int32_t above = -1;
+  for (int i = 0; i < mapHeight_; i++) {
+    if (cellBlocked(x, i)) {
+      above = i;
+    }
+    blockedAbove_[column + i] = above;
+  }
+
+  std::int32_t below = mapHeight_;
+  for (int i = mapHeight_ - 1; i >= 0; i--) {
+    if (blockedAbove_[column + i] == i) {
+      below = i;
+    }
+    blockedBelow_[column + i] = below;
+  }
+}
+
+bool Map::setTile(const int layer, const int x, const int y,
+                  const TileId tile) {
+  if (layer < 0 || layer >= (int)layers_.size() || x < 0 || x >= mapWidth_ ||
+      y < 0 || y >= mapHeight_) {
+    logger::warning("Tile out of range: layer " + std::to_string(layer) +
+                    " (" + std::to_string(x) + ", " + std::to_string(y) +
+                    ")");
+    return false;
+  }
+
+  layers_[layer].setTileAt(x, y, tile);
+
+  TileId topmost = 0;
+  for (int k = (int)layers_.size() - 1; k >= 0; k--) {
+    topmost = layers_[k].tileAt(x, y);
+    if (topmost != 0) {
+      break;
+    }
+  }
+  topmost_[(std::size_t)y * mapWidth_ + x] = topmost;
+
+  const std::uint64_t bit = (std::uint64_t)1 << (x % 64);
+  auto& word = solid_[y * solidRowWords_ + x / 64];
+  if (topmost != 0 && !walkable(topmost)) {
+    word |= bit;
+  } else {
+    word &= ~bit;
+  }
+
+  buildColumn(x);
+
+  chunk(layer, x / CHUNK_TILES, y / CHUNK_TILES).dirty = true;
+
+  uncachedCells_[(std::size_t)y * mapWidth_ + x] = cellUncached(x, y);
+  if (cachedTiles_.contains(x, y)) {
+    cachedTiles_ = sf::IntRect();
   }
 
   return true;
 }
 
+void Map::buildTopmost() {
+  topmost_.assign((std::size_t)mapWidth_ * mapHeight_, 0);
+  for (int i = 0; i < mapHeight_; i++) {
+    for (int j = 0; j < mapWidth_; j++) {
+      for (int k = (int)layers_.size() - 1; k >= 0; k--) {
+        const auto tile = layers_[k].tileAt(j, i);
+        if (tile != 0) {
+          topmost_[(std::size_t)i * mapWidth_ + j] = tile;
+          break;
+        }
+      }
+    }
+  }
+}
+
 void Map::ensurePointInMap(sf::Vector2f& p) {
   util::clamp<float>(p.x, 0.f, (float)mapWidth_ - 1);
   util::clamp<float>(p.y, 0.f, (float)mapHeight_ - 1);
 }
 
+void Map::buildSolidity() {
+  solidRowWords_ = ((std::size_t)mapWidth_ + 63) / 64;
+  solid_.assign(solidRowWords_ * mapHeight_, 0);
+
+  // Maps reuse a handful of tiles, so only look each one up once
+  std::unordered_map<TileId, bool> solidTiles;
+  for (int i = 0; i < mapHeight_; i++) {
+    for (int j = 0; j < mapWidth_; j++) {
+      const auto tile = topmostAt(j, i);
+      if (tile == 0) {
+        continue;
+      }
+      auto cached = solidTiles.find(tile);
+      if (cached == solidTiles.end()) {
+        cached = solidTiles.emplace(tile, !walkable(tile)).first;
+      }
+      if (cached->second) {
+        solid_[i * solidRowWords_ + j / 64] |= (std::uint64_t)1 << (j % 64);
+      }
+    }
+  }
+}
+
+bool Map::cellsSolid(const int left, const int top, const int right,
+                     const int bottom) const {
+  const int firstWord = left / 64;
+  const int lastWord = right / 64;
+  const std::uint64_t firstMask = ~(std::uint64_t)0 << (left % 64);
+  const std::uint64_t lastMask = ~(std::uint64_t)0 >> (63 - right % 64);
+
+  for (int i = top; i <= bottom; i++) {
+    const auto row = &solid_[i * solidRowWords_];
+    for (int word = firstWord; word <= lastWord; word++) {
+      std::uint64_t mask = ~(std::uint64_t)0;
+      if (word == firstWord) {
+        mask &= firstMask;
+      }
+      if (word == lastWord) {
+        mask &= lastMask;
+      }
+      if (row[word] & mask) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
 sf::Vector2f Map::mapToPixel(const float x, const float y) {
   sf::Vector2f pixelPosition(x, y);
   ensurePointInMap(pixelPosition);
@@ -79,37 +312,30 @@ std::set<TileId> Map::hitTiles(const float x, const float y, const float w,
   std::set<TileId> tiles;
   for (int i = (int)topLeft.y; i <= (int)bottomRight.y; i++) {
     for (int j = (int)topLeft.x; j <= (int)bottomRight.x; j++) {
-      for (int k = (int)layers_.size() - 1; k >= 0; k--) {
-        const auto tile = layers_[k].tileAt(j, i);
-        if (tile != 0) {
-          tiles.insert(tile);
-          break;
-        }
+      const auto tile = topmostAt(j, i);
+      if (tile != 0) {
+        tiles.insert(tile);
       }
     }
   }
   return tiles;
 }
 
-// This should be combined with the one below somehow
 float Map::positionOfTileAbove(const sf::FloatRect dim) {
   auto topLeft = pixelToMap(dim.left, dim.top);
   auto topRight = pixelToMap(dim.left + dim.width - 1, dim.top);
 
-  for (int i = (int)topLeft.y; i >= 0; i--) {
-    for (int j = (int)topLeft.x; j <= (int)topRight.x; j++) {
-      for (int k = (int)layers_.size() - 1; k >= 0; k--) {
-        const auto tile = layers_[k].tileAt(j, i);
-        if (tile == 0 || walkable(tile)) {
-          continue;
-        }
-        auto newPos = mapToPixel((float)j, (float)i);
-        return newPos.y + tileHeight_;
-      }
-    }
+  std::int32_t row = -1;
+  for (int j = (int)topLeft.x; j <= (int)topRight.x; j++) {
+    row = std::max(row,
+                   blockedAbove_[(std::size_t)j * mapHeight_ + (int)topLeft.y]);
+  }
+  if (row < 0) {
+    return 0;
   }
 
-  return 0;
+  auto newPos = mapToPixel(0.f, (float)row);
+  return newPos.y + tileHeight_;
 }
 
 float Map::positionOfTileBelow(const sf::FloatRect dim) {
@@ -117,20 +343,17 @@ float Map::positionOfTileBelow(const sf::FloatRect dim) {
   auto bottomRight =
       pixelToMap(dim.left + dim.width - 1, dim.top + dim.height - 1);
 
-  for (int i = (int)bottomLeft.y; i < mapHeight_; i++) {
-    for (int j = (int)bottomLeft.x; j <= (int)bottomRight.x; j++) {
-      for (int k = (int)layers_.size() - 1; k >= 0; k--) {
-        const auto tile = layers_[k].tileAt(j, i);
-        if (tile == 0 || walkable(tile)) {
-          continue;
-        }
-        auto newPos = mapToPixel((float)j, (float)i);
-        return newPos.y - dim.height;
-      }
-    }
+  std::int32_t row = mapHeight_;
+  for (int j = (int)bottomLeft.x; j <= (int)bottomRight.x; j++) {
+    row = std::min(
+        row, blockedBelow_[(std::size_t)j * mapHeight_ + (int)bottomLeft.y]);
+  }
+  if (row >= mapHeight_) {
+    return std::numeric_limits<float>::max();
   }
 
-  return std::numeric_limits<float>::max();
+  auto newPos = mapToPixel(0.f, (float)row);
+  return newPos.y - dim.height;
 }
 
 bool Map::positionWalkable(const float x, const float y, const float w,
@@ -140,60 +363,377 @@ bool Map::positionWalkable(const float x, const float y, const float w,
     return false;
   }
 
-  std::set<TileId> tiles = hitTiles(x, y, w, h);
-  for (const auto tile : tiles) {
-    if (tile == 0) {
-      continue;
-    }
-    if (!walkable(tile)) {
-      return false;
+  // Same cells hitTiles would visit
+  const auto topLeft = pixelToMap(x, y);
+  const auto bottomRight = pixelToMap(x + w - 1, y + h - 1);
+  return !cellsSolid((int)topLeft.x, (int)topLeft.y, (int)bottomRight.x,
+                     (int)bottomRight.y);
+}
+
+Sweep Map::sweep(const sf::FloatRect rect, const sf::Vector2f delta) {
+  const float tileWidth = (float)tileWidth_;
+  const float tileHeight = (float)tileHeight_;
+  const float infinity = std::numeric_limits<float>::infinity();
+
+  // Leading column and row past the ones covered, and the times the
+  // leading edges reach them and take to cross a whole cell
+  int column = 0, row = 0;
+  float nextX = infinity, nextY = infinity;
+  float stepX = infinity, stepY = infinity;
+  if (delta.x > 0) {
+    const float right = rect.left + rect.width;
+    column = (int)std::ceil((right - SWEEP_EPSILON) / tileWidth);
+    nextX = std::max(0.f, (column * tileWidth - right) / delta.x);
+    stepX = tileWidth / delta.x;
+  } else if (delta.x < 0) {
+    column = (int)std::floor((rect.left + SWEEP_EPSILON) / tileWidth) - 1;
+    nextX = std::max(0.f, ((column + 1) * tileWidth - rect.left) / delta.x);
+    stepX = -tileWidth / delta.x;
+  }
+  if (delta.y > 0) {
+    const float bottom = rect.top + rect.height;
+    row = (int)std::ceil((bottom - SWEEP_EPSILON) / tileHeight);
+    nextY = std::max(0.f, (row * tileHeight - bottom) / delta.y);
+    stepY = tileHeight / delta.y;
+  } else if (delta.y < 0) {
+    row = (int)std::floor((rect.top + SWEEP_EPSILON) / tileHeight) - 1;
+    nextY = std::max(0.f, ((row + 1) * tileHeight - rect.top) / delta.y);
+    stepY = -tileHeight / delta.y;
+  }
+
+  // Checks the cells of one column or row the rectangle covers at a time,
+  // along with the cells it enters there
+  Sweep sweep;
+  while (nextX <= 1 || nextY <= 1) {
+    if (nextX <= nextY) {
+      const float y = rect.top + delta.y * nextX;
+      const int top = (int)std::floor((y + SWEEP_EPSILON) / tileHeight);
+      const int bottom =
+          (int)std::ceil((y + rect.height - SWEEP_EPSILON) / tileHeight);
+      if (!positionWalkable(column * tileWidth, top * tileHeight, tileWidth,
+                            (bottom - top) * tileHeight)) {
+        sweep.time = nextX;
+        sweep.normal.x = delta.x > 0 ? -1.f : 1.f;
+        return sweep;
+      }
+      column += delta.x > 0 ? 1 : -1;
+      nextX += stepX;
+    } else {
+      const float x = rect.left + delta.x * nextY;
+      const int left = (int)std::floor((x + SWEEP_EPSILON) / tileWidth);
+      const int right =
+          (int)std::ceil((x + rect.width - SWEEP_EPSILON) / tileWidth);
+      if (!positionWalkable(left * tileWidth, row * tileHeight,
+                            (right - left) * tileWidth, tileHeight)) {
+        sweep.time = nextY;
+        sweep.normal.y = delta.y > 0 ? -1.f : 1.f;
+        return sweep;
+      }
+      row += delta.y > 0 ? 1 : -1;
+      nextY += stepY;
     }
   }
-  return true;
+  return sweep;
 }
 
-Tileset* Map::tilesetForTile(const TileId tile) {
+void Map::buildGidTable() {
+  TileId end = 0;
   for (const auto& tileset : tilesets_) {
-    if (tileset->contains(tile)) {
-      return tileset.get();
+    end = std::max(end, tileset->firstGid() + tileset->tileCount());
+  }
+
+  gids_.assign(end, GidEntry());
+
+  // Earlier tilesets win overlapping ranges, like a front to back search
+  for (auto iter = tilesets_.rbegin(); iter != tilesets_.rend(); ++iter) {
+    const auto& tileset = *iter;
+    for (int i = 0; i < tileset->tileCount(); i++) {
+      auto& entry = gids_[tileset->firstGid() + i];
+      entry.tileset = tileset.get();
+      entry.local = (TileId)i;
     }
   }
-  logger::error("Could not find tileset for " + tile);
-  return nullptr;
+}
+
+Tileset* Map::tilesetForTile(const TileId tile) {
+  const TileId gid = tile & ~TILE_FLAGS_MASK;
+  if (gid >= gids_.size()) {
+    return nullptr;
+  }
+  return gids_[gid].tileset;
 }
 
 bool Map::walkable(const TileId tile) {
-  const auto& tileset = tilesetForTile(tile);
-  if (!tileset) {
+  const TileId gid = tile & ~TILE_FLAGS_MASK;
+  if (gid >= gids_.size() || !gids_[gid].tileset) {
     return false;
   }
-  return tileset->walkable(tile);
+  const auto& entry = gids_[gid];
+  return entry.tileset->tile(entry.local).walkable;
+}
+
+std::size_t Map::memoryUsage() {
+  std::size_t bytes = sizeof(*this);
+  for (const auto& layer : layers_) {
+    bytes += layer.memoryUsage();
+  }
+  bytes += topmost_.capacity() * sizeof(TileId);
+  bytes += solid_.capacity() * sizeof(std::uint64_t);
+  bytes += (blockedAbove_.capacity() + blockedBelow_.capacity()) *
+           sizeof(std::int32_t);
+  bytes += gids_.capacity() * sizeof(GidEntry);
+  bytes += uncachedCells_.capacity() / 8;
+
+  for (const auto& chunk : chunks_) {
+    for (const auto& mesh : chunk.meshes) {
+      bytes += mesh.vertices->capacity() * sizeof(sf::Vertex);
+    }
+  }
+
+  // Textures are counted at 4 bytes a pixel, even though they live on the GPU
+  for (const auto& tileset : tilesets_) {
+    if (tileset->texture()) {
+      const auto size = tileset->texture()->getSize();
+      bytes += (std::size_t)size.x * size.y * 4;
+    }
+  }
+  if (scrollCache_) {
+    const auto size = scrollCache_->getSize();
+    bytes += (std::size_t)size.x * size.y * 4;
+  }
+
+  return bytes;
 }
 
 bool Map::update(const sf::Time& time) {
+  animationFrame_ = 0;
   for (const auto& tileset : tilesets_) {
     tileset->update(time);
+    animationFrame_ += tileset->animationFrame();
   }
 
   return true;
 }
 
-void Map::render(sf::RenderTarget& window, const sf::Vector2f cameraPos) {
-  int xStart, xEnd;
-  int yStart, yEnd;
-  xStart = 0;
-  xEnd = mapWidth_;
+sf::IntRect Map::visibleTiles(const sf::Vector2f cameraPos) {
+  const float left = cameraPos.x - position_.x;
+  const float top = cameraPos.y - position_.y;
+
+  int xStart = (int)std::floor(left / tileWidth_) - 1;
+  int xEnd = (int)std::ceil((left + SCREEN_WIDTH) / tileWidth_) + 1;
+  int yStart = (int)std::floor(top / tileHeight_) - 1;
+  int yEnd = (int)std::ceil((top + SCREEN_HEIGHT) / tileHeight_) + 1;
+
+  util::clamp<int>(xStart, 0, mapWidth_);
+  util::clamp<int>(xEnd, 0, mapWidth_);
+  util::clamp<int>(yStart, 0, mapHeight_);
+  util::clamp<int>(yEnd, 0, mapHeight_);
+
+  return sf::IntRect(xStart, yStart, xEnd - xStart, yEnd - yStart);
+}
+
+void Map::buildChunk(const int layer, const int x, const int y) {
+  auto& built = chunk(layer, x, y);
+  built.meshes.clear();
+  built.animated = false;
+
+  // Vertices per tileset, in the order tilesets are first used
+  std::vector<std::pair<Tileset*, std::shared_ptr<std::vector<sf::Vertex>>>>
+      meshes;
+
+  const int xEnd = std::min((x + 1) * CHUNK_TILES, mapWidth_);
+  const int yEnd = std::min((y + 1) * CHUNK_TILES, mapHeight_);
+  for (int i = y * CHUNK_TILES; i < yEnd; i++) {
+    for (int j = x * CHUNK_TILES; j < xEnd; j++) {
+      const TileId tile = layers_[layer].tileAt(j, i);
+      if (tile == 0) {
+        continue;
+      }
+      const TileId gid = tile & ~TILE_FLAGS_MASK;
+      if (gid >= gids_.size() || !gids_[gid].tileset) {
+        continue;
+      }
+      const auto& entry = gids_[gid];
+      if (entry.tileset->tile(entry.local).animationTiles.size() > 1) {
+        built.animated = true;
+      }
+
+      std::vector<sf::Vertex>* vertices = nullptr;
+      for (const auto& mesh : meshes) {
+        if (mesh.first == entry.tileset) {
+          vertices = mesh.second.get();
+          break;
+        }
+      }
+      if (!vertices) {
+        meshes.emplace_back(entry.tileset,
+                            std::make_shared<std::vector<sf::Vertex>>());
+        vertices = meshes.back().second.get();
+      }
+      entry.tileset->appendTile(*vertices, tile,
+                                (float)(j * entry.tileset->width()),
+                                (float)(i * entry.tileset->height()));
+    }
+  }
 
-  yStart = 0;
-  yEnd = mapHeight_;
+  for (const auto& mesh : meshes) {
+    if (mesh.first->texture() && !mesh.second->empty()) {
+      built.meshes.push_back({mesh.first->texture(), mesh.second});
+    }
+  }
 
-  auto x = position_.x - cameraPos.x;
-  auto y = position_.y - cameraPos.y;
+  built.frame = animationFrame_;
+  built.dirty = false;
+}
 
-  for (auto& layer : layers_) {
+void Map::visibleMeshes(const sf::Vector2f cameraPos,
+                        const std::function<void(const ChunkMesh&)>& func) {
+  const auto visible = visibleTiles(cameraPos);
+  const int xStart = visible.left / CHUNK_TILES;
+  const int xEnd = (visible.left + visible.width + CHUNK_TILES - 1) /
+                   CHUNK_TILES;
+  const int yStart = visible.top / CHUNK_TILES;
+  const int yEnd = (visible.top + visible.height + CHUNK_TILES - 1) /
+                   CHUNK_TILES;
+
+  for (int k = 0; k < (int)layers_.size(); k++) {
     for (int i = yStart; i < yEnd; i++) {
       for (int j = xStart; j < xEnd; j++) {
-        const TileId tile = layer.tiles[i][j];
+        auto& cached = chunk(k, j, i);
+        if (cached.dirty ||
+            (cached.animated && cached.frame != animationFrame_)) {
+          buildChunk(k, j, i);
+        }
+        for (const auto& mesh : cached.meshes) {
+          func(mesh);
+        }
+      }
+    }
+  }
+}
+
+bool Map::cellUncached(const int x, const int y) {
+  for (const auto& layer : layers_) {
+    const TileId tile = layer.tileAt(x, y);
+    if (tile & TILE_FLIPPED_DIAGONALLY) {
+      return true;
+    }
+    const TileId gid = tile & ~TILE_FLAGS_MASK;
+    if (gid != 0 && gid < gids_.size() && gids_[gid].tileset &&
+        gids_[gid].tileset->tile(gids_[gid].local).animationTiles.size() > 1) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void Map::paintCachedCell(const int x, const int y) {
+  const float left = (float)(x % cacheTilesWide_ * tileWidth_);
+  const float top = (float)(y % cacheTilesHigh_ * tileHeight_);
+  const float right = left + tileWidth_;
+  const float bottom = top + tileHeight_;
+
+  // Overwrite whatever cell used the slot before
+  const sf::Vertex clear[] = {
+      sf::Vertex(sf::Vector2f(left, top), sf::Color::Transparent,
+                 sf::Vector2f()),
+      sf::Vertex(sf::Vector2f(right, top), sf::Color::Transparent,
+                 sf::Vector2f()),
+      sf::Vertex(sf::Vector2f(right, bottom), sf::Color::Transparent,
+                 sf::Vector2f()),
+      sf::Vertex(sf::Vector2f(left, bottom), sf::Color::Transparent,
+                 sf::Vector2f()),
+  };
+  sf::RenderStates states;
+  states.blendMode = sf::BlendNone;
+  scrollCache_->draw(clear, 4, sf::Quads, states);
+
+  if (uncachedCells_[(std::size_t)y * mapWidth_ + x]) {
+    return;
+  }
+
+  for (const auto& layer : layers_) {
+    const TileId tile = layer.tileAt(x, y);
+    if (tile == 0) {
+      continue;
+    }
+    const auto& tileset = tilesetForTile(tile);
+    if (!tileset) {
+      continue;
+    }
+    tileset->renderTile(*scrollCache_, tile, left, top);
+  }
+}
+
+void Map::renderScrollCached(sf::RenderTarget& window,
+                             const sf::Vector2f cameraPos) {
+  if (!scrollCache_) {
+    // One spare cell each way so a screen straddling cells fits
+    cacheTilesWide_ = SCREEN_WIDTH / tileWidth_ + 2;
+    cacheTilesHigh_ = SCREEN_HEIGHT / tileHeight_ + 2;
+    scrollCache_ = std::make_unique<sf::RenderTexture>();
+    scrollCache_->create(cacheTilesWide_ * tileWidth_,
+                         cacheTilesHigh_ * tileHeight_);
+    // Sampling past the edge wraps, so the cache is drawn with one quad
+    scrollCache_->setRepeated(true);
+    cachedTiles_ = sf::IntRect();
+  }
+
+  const float left = cameraPos.x - position_.x;
+  const float top = cameraPos.y - position_.y;
+
+  int xStart = (int)std::floor(left / tileWidth_);
+  int xEnd = (int)std::floor((left + SCREEN_WIDTH - 1) / tileWidth_) + 1;
+  int yStart = (int)std::floor(top / tileHeight_);
+  int yEnd = (int)std::floor((top + SCREEN_HEIGHT - 1) / tileHeight_) + 1;
+  util::clamp<int>(xStart, 0, mapWidth_);
+  util::clamp<int>(xEnd, 0, mapWidth_);
+  util::clamp<int>(yStart, 0, mapHeight_);
+  util::clamp<int>(yEnd, 0, mapHeight_);
+  if (xStart >= xEnd || yStart >= yEnd) {
+    return;
+  }
+
+  // Only cells scrolling into view need painting
+  bool painted = false;
+  for (int i = yStart; i < yEnd; i++) {
+    for (int j = xStart; j < xEnd; j++) {
+      if (!cachedTiles_.contains(j, i)) {
+        paintCachedCell(j, i);
+        painted = true;
+      }
+    }
+  }
+  cachedTiles_ = sf::IntRect(xStart, yStart, xEnd - xStart, yEnd - yStart);
+  if (painted) {
+    scrollCache_->display();
+  }
+
+  // Texture coordinates are map pixels, which wrap onto the cache slots
+  const float mapLeft = (float)(xStart * tileWidth_);
+  const float mapTop = (float)(yStart * tileHeight_);
+  const float mapRight = (float)(xEnd * tileWidth_);
+  const float mapBottom = (float)(yEnd * tileHeight_);
+  const sf::Vertex blit[] = {
+      sf::Vertex(sf::Vector2f(mapLeft - left, mapTop - top),
+                 sf::Vector2f(mapLeft, mapTop)),
+      sf::Vertex(sf::Vector2f(mapRight - left, mapTop - top),
+                 sf::Vector2f(mapRight, mapTop)),
+      sf::Vertex(sf::Vector2f(mapRight - left, mapBottom - top),
+                 sf::Vector2f(mapRight, mapBottom)),
+      sf::Vertex(sf::Vector2f(mapLeft - left, mapBottom - top),
+                 sf::Vector2f(mapLeft, mapBottom)),
+  };
+  window.draw(blit, 4, sf::Quads, &scrollCache_->getTexture());
+
+  // Uncached cells are left empty, so draw every layer of them on top
+  for (int i = yStart; i < yEnd; i++) {
+    for (int j = xStart; j < xEnd; j++) {
+      if (!uncachedCells_[(std::size_t)i * mapWidth_ + j]) {
+        continue;
+      }
+      for (const auto& layer : layers_) {
+        const TileId tile = layer.tileAt(j, i);
         if (tile == 0) {
           continue;
         }
@@ -201,25 +741,112 @@ void Map::render(sf::RenderTarget& window, const sf::Vector2f cameraPos) {
         if (!tileset) {
           continue;
         }
-        tileset->renderTile(window, tile, x + j * tileset->width(),
-                            y + i * tileset->height());
+        tileset->renderTile(window, tile, j * tileWidth_ - left,
+                            i * tileHeight_ - top);
       }
     }
   }
 }
 
+void Map::render(sf::RenderTarget& window, const sf::Vector2f cameraPos) {
+  if (scrollCacheEnabled_) {
+    renderScrollCached(window, cameraPos);
+    return;
+  }
+
+  sf::RenderStates states;
+  states.transform.translate(position_ - cameraPos);
+
+  visibleMeshes(cameraPos, [&window, &states](const ChunkMesh& mesh) {
+    states.texture = mesh.texture.get();
+    window.draw(&(*mesh.vertices)[0], mesh.vertices->size(), sf::Quads,
+                states);
+  });
+}
+
+void Map::snapshot(RenderSnapshot& snapshot, const sf::Vector2f cameraPos) {
+  sf::Transform transform;
+  transform.translate(position_ - cameraPos);
+
+  visibleMeshes(cameraPos, [&snapshot, &transform](const ChunkMesh& mesh) {
+    snapshot.addMesh(mesh.texture, mesh.vertices, transform);
+  });
+}
+
 MapLayer::MapLayer(const nlohmann::json& layerData) {
-  auto width = layerData["width"].get<int>();
-  auto height = layerData["height"].get<int>();
-  auto data = layerData["data"].get<std::vector<int>>();
-  auto data_iter = data.begin();
-  for (int i = 0; i < height; i++) {
-    std::vector<TileId> row;
-    for (int j = 0; j < width; j++) {
-      row.push_back(*data_iter);
-      data_iter++;
-    }
-    tiles.push_back(row);
+  width_ = layerData["width"].get<int>();
+  height_ = layerData["height"].get<int>();
+  const auto data = layerData["data"].get<std::vector<TileId>>();
+  const std::size_t count = (std::size_t)width_ * height_;
+  if (data.size() < count) {
+    logger::error("Map layer has " + std::to_string(data.size()) +
+                  " tiles, expected " + std::to_string(count));
+  }
+
+  bool fitsNarrow = true;
+  for (std::size_t i = 0; i < count && i < data.size(); i++) {
+    if ((data[i] & ~TILE_FLAGS_MASK) >= NARROW_ID_LIMIT) {
+      fitsNarrow = false;
+      break;
+    }
+  }
+
+  if (fitsNarrow) {
+    narrowTiles_.resize(count, 0);
+    for (std::size_t i = 0; i < count && i < data.size(); i++) {
+      narrowTiles_[i] = narrowTile(data[i]);
+    }
+    narrow_ = true;
+    narrowData_ = narrowTiles_.data();
+  } else {
+    tiles_.assign(data.begin(), data.begin() + std::min(count, data.size()));
+    tiles_.resize(count, 0);
+    tileData_ = tiles_.data();
+  }
+}
+
+MapLayer::MapLayer(const int width, const int height, const bool narrow,
+                   const void* plane)
+    : width_(width), height_(height), narrow_(narrow) {
+  if (narrow_) {
+    narrowData_ = static_cast<const std::uint16_t*>(plane);
+  } else {
+    tileData_ = static_cast<const TileId*>(plane);
+  }
+}
+
+void MapLayer::ownTiles() {
+  const std::size_t count = (std::size_t)width_ * height_;
+  if (narrow_ && narrowTiles_.empty()) {
+    narrowTiles_.assign(narrowData_, narrowData_ + count);
+    narrowData_ = narrowTiles_.data();
+  } else if (!narrow_ && tiles_.empty()) {
+    tiles_.assign(tileData_, tileData_ + count);
+    tileData_ = tiles_.data();
+  }
+}
+
+void MapLayer::setTileAt(const int x, const int y, const TileId tile) {
+  const std::size_t index = (std::size_t)y * width_ + x;
+  if (narrow_ && (tile & ~TILE_FLAGS_MASK) >= NARROW_ID_LIMIT) {
+    tiles_.resize((std::size_t)width_ * height_);
+    for (int i = 0; i < height_; i++) {
+      for (int j = 0; j < width_; j++) {
+        tiles_[(std::size_t)i * width_ + j] = tileAt(j, i);
+      }
+    }
+    narrowTiles_.clear();
+    narrowTiles_.shrink_to_fit();
+    narrow_ = false;
+    narrowData_ = nullptr;
+    tileData_ = tiles_.data();
+  }
+  ownTiles();
+
+  if (narrow_) {
+    narrowTiles_[index] = narrowTile(tile);
+  } else {
+    tiles_[index] = tile;
   }
 }
 
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "mapped_file.h"
 #include "tileset.h"
 #include "util.h"
 
@@ -7,20 +8,112 @@
 
 #include <SFML/Graphics.hpp>
 
+#include <cstdint>
+#include <functional>
+#include <memory>
 #include <set>
 #include <string>
+#include <vector>
 
 namespace map {
 
 /**
- * Class to load and contain a map layer
+ * Enables or disables drawing static tiles from a wrap-around texture that
+ * only repaints cells scrolling into view. Applies to Map::render, not to
+ * render snapshots.
+ *
+ * @param enabled Whether to use the scroll cache
+ */
+void setScrollCache(bool enabled);
+
+/**
+ * Gets whether the scroll cache is enabled
+ *
+ * @return Whether the scroll cache is enabled
+ */
+bool scrollCache();
+
+/**
+ * Class to load and contain a map layer. Tiles are stored row-major in one
+ * buffer, narrowed to 16 bits when the layer's tile IDs fit. Layers of
+ * compiled maps read their tiles straight from the mapped file until the
+ * first change.
  */
 class MapLayer {
- public:
-  std::vector<std::vector<TileId>> tiles;
+ private:
+  // Narrow layers keep the flip flags in the top 3 bits of 16
+  static constexpr int NARROW_FLAGS_SHIFT = 16;
+  static constexpr TileId NARROW_ID_LIMIT = 0x2000;
+
+  int width_ = 0;
+  int height_ = 0;
+  bool narrow_ = false;
+
+  // Tiles owned by the layer. Both are empty while reading a mapped plane.
+  std::vector<std::uint16_t> narrowTiles_;
+  std::vector<TileId> tiles_;
+
+  // The tiles read from, in either the vectors above or a mapped file.
+  // Exactly one of these is set.
+  const std::uint16_t* narrowData_ = nullptr;
+  const TileId* tileData_ = nullptr;
+
+  /**
+   * Packs a tile into 16 bits. Only valid for tiles below NARROW_ID_LIMIT.
+   *
+   * @param tile Tile to pack
+   * @return Packed tile
+   */
+  std::uint16_t narrowTile(const TileId tile) const {
+    return (std::uint16_t)((tile & ~TILE_FLAGS_MASK) |
+                           ((tile & TILE_FLAGS_MASK) >> NARROW_FLAGS_SHIFT));
+  }
 
+  /**
+   * Copies a mapped plane into the layer so it can be changed
+   */
+  void ownTiles();
+
+ public:
   MapLayer(const nlohmann::json& layerData);
 
+  /**
+   * Creates a layer reading its tiles from a plane in runtime layout
+   * without copying them. The plane must outlive the layer.
+   *
+   * @param width Width in tiles
+   * @param height Height in tiles
+   * @param narrow Whether the plane holds 16 bit tiles
+   * @param plane Row-major tiles
+   */
+  MapLayer(const int width, const int height, const bool narrow,
+           const void* plane);
+
+  // Copies would point at the original's tiles
+  MapLayer(const MapLayer&) = delete;
+  MapLayer(MapLayer&&) = default;
+
+  /**
+   * Gets the layer width in tiles
+   *
+   * @return Width in tiles
+   */
+  int width() const { return width_; }
+
+  /**
+   * Gets the layer height in tiles
+   *
+   * @return Height in tiles
+   */
+  int height() const { return height_; }
+
+  /**
+   * Gets whether the layer is stored with 16 bit tiles
+   *
+   * @return Whether the layer is narrow
+   */
+  bool narrow() const { return narrow_; }
+
   /**
    * Gets the tile at a given (x, y) coordinate
    *
@@ -28,7 +121,15 @@ class MapLayer {
    * @param y Y coordinate of tile
    * @return Tile number of tile at point
    */
-  TileId tileAt(const int x, const int y) { return tiles[y][x]; }
+  TileId tileAt(const int x, const int y) const {
+    const std::size_t index = (std::size_t)y * width_ + x;
+    if (narrow_) {
+      const TileId tile = narrowData_[index];
+      return (tile & ~(TILE_FLAGS_MASK >> NARROW_FLAGS_SHIFT)) |
+             ((tile << NARROW_FLAGS_SHIFT) & TILE_FLAGS_MASK);
+    }
+    return tileData_[index];
+  }
 
   /**
    * Gets the tile at a given sf::Vector2f
@@ -36,35 +137,304 @@ class MapLayer {
    * @param p Location of tile
    * @return Tile number of tile at point
    */
-  TileId tileAt(const sf::Vector2f p) { return tileAt((int)p.x, (int)p.y); }
+  TileId tileAt(const sf::Vector2f p) const {
+    return tileAt((int)p.x, (int)p.y);
+  }
+
+  /**
+   * Sets the tile at a given (x, y) coordinate, widening the layer if the
+   * tile doesn't fit in 16 bits
+   *
+   * @param x X coordinate of tile
+   * @param y Y coordinate of tile
+   * @param tile New tile number
+   */
+  void setTileAt(const int x, const int y, const TileId tile);
+
+  /**
+   * Gets the layer's tiles in runtime layout, as stored in compiled maps
+   *
+   * @return Row-major tiles, 16 bits each if narrow and 32 otherwise
+   */
+  const void* plane() const {
+    return narrow_ ? (const void*)narrowData_ : (const void*)tileData_;
+  }
+
+  /**
+   * Gets the size of the layer's tiles in runtime layout
+   *
+   * @return Size in bytes
+   */
+  std::size_t planeBytes() const {
+    return (std::size_t)width_ * height_ *
+           (narrow_ ? sizeof(std::uint16_t) : sizeof(TileId));
+  }
+
+  /**
+   * Gets the bytes used by tiles the layer owns. Mapped tiles aren't
+   * counted since the OS can drop them at any time.
+   *
+   * @return Bytes used
+   */
+  std::size_t memoryUsage() const {
+    return narrowTiles_.capacity() * sizeof(std::uint16_t) +
+           tiles_.capacity() * sizeof(TileId);
+  }
+};
+
+/**
+ * Result of sweeping a rectangle through a map
+ */
+struct Sweep {
+  // Fraction of the move made before touching a dense tile or the edge of
+  // the map, 1 if nothing was touched
+  float time = 1;
+
+  // Normal of the surface touched, zero if nothing was touched. Set even
+  // when the move ends exactly on contact.
+  sf::Vector2f normal;
 };
 
 /**
  * Class to load, update, and render a tile map
  */
 class Map {
- private:
+ protected:
   std::string path_;
 
   sf::Vector2f position_;
 
   // Map dimensions in tiles
-  int mapWidth_, mapHeight_;
+  int mapWidth_ = 0, mapHeight_ = 0;
 
   // Map dimentions in pixels
-  int mapPixelWidth_, mapPixelHeight_;
+  int mapPixelWidth_ = 0, mapPixelHeight_ = 0;
 
   // Tile dimensions in pixels
-  int tileWidth_, tileHeight_;
+  int tileWidth_ = 0, tileHeight_ = 0;
+
+  /**
+   * Creates an empty map for subclasses that fill in the dimensions
+   * themselves
+   */
+  Map() {}
+
+ private:
+  // Distance in pixels an edge may cross into a cell without covering it,
+  // so rounding can't put a rectangle moved to contact inside a wall
+  static constexpr float SWEEP_EPSILON = 1e-3f;
 
   // Vector of layers of tile maps
   std::vector<MapLayer> layers_;
 
+  // Row-major topmost nonzero tile of each cell across all layers, which is
+  // the tile collisions are checked against
+  std::vector<TileId> topmost_;
+
+  // One bit per cell, set where the topmost tile isn't walkable. Rows are
+  // padded to whole words so each row starts on a word boundary.
+  std::vector<std::uint64_t> solid_;
+  std::size_t solidRowWords_ = 0;
+
+  // Per column, the nearest row at or above (or below) each cell holding a
+  // non-walkable tile on any layer. Stored column-major, with -1 above and
+  // mapHeight_ below when there is none.
+  std::vector<std::int32_t> blockedAbove_;
+  std::vector<std::int32_t> blockedBelow_;
+
+  /**
+   * Fills topmost_ from the layers
+   */
+  void buildTopmost();
+
+  /**
+   * Checks whether a cell holds a non-walkable tile on any layer
+   *
+   * @param x X coordinate of cell
+   * @param y Y coordinate of cell
+   * @return Whether the cell is blocked
+   */
+  bool cellBlocked(const int x, const int y);
+
+  /**
+   * Fills blockedAbove_ and blockedBelow_ for a column
+   *
+   * @param x Column to fill
+   */
+  void buildColumn(const int x);
+
+  /**
+   * Fills solid_ from topmost_
+   */
+  void buildSolidity();
+
+  /**
+   * Checks whether any cell in an inclusive rectangle of cells is solid
+   *
+   * @param left Leftmost cell column
+   * @param top Topmost cell row
+   * @param right Rightmost cell column
+   * @param bottom Bottommost cell row
+   * @return Whether any cell is solid
+   */
+  bool cellsSolid(const int left, const int top, const int right,
+                  const int bottom) const;
+
+  /**
+   * Gets the topmost nonzero tile at a cell
+   *
+   * @param x X coordinate of cell
+   * @param y Y coordinate of cell
+   * @return Topmost tile, or 0 if every layer is empty there
+   */
+  TileId topmostAt(const int x, const int y) const {
+    return topmost_[(std::size_t)y * mapWidth_ + x];
+  }
+
   // Vector of tilesets used in the map
   std::vector<std::unique_ptr<Tileset>> tilesets_;
 
   /**
-   * Load a map from the given path
+   * Tileset owning a global tile ID and the tile's ID within it
+   */
+  struct GidEntry {
+    Tileset* tileset = nullptr;
+    TileId local = 0;
+  };
+
+  // Indexed by global tile ID without flip flags
+  std::vector<GidEntry> gids_;
+
+  /**
+   * Fills gids_ from the tilesets
+   */
+  void buildGidTable();
+
+  // Width and height of a render chunk in tiles
+  static constexpr int CHUNK_TILES = 16;
+
+  /**
+   * Cached quads for one tileset texture in a chunk. The vertices are
+   * replaced rather than modified, so snapshots can keep drawing old ones.
+   */
+  struct ChunkMesh {
+    std::shared_ptr<const sf::Texture> texture;
+    std::shared_ptr<const std::vector<sf::Vertex>> vertices;
+  };
+
+  /**
+   * Cached geometry for a CHUNK_TILES square of one layer, positioned
+   * relative to the map
+   */
+  struct MapChunk {
+    std::vector<ChunkMesh> meshes;
+    bool dirty = true;
+
+    // Whether the chunk has animated tiles, and the animation frame it was
+    // built for if so
+    bool animated = false;
+    unsigned int frame = 0;
+  };
+
+  int chunksWide_ = 0;
+  int chunksHigh_ = 0;
+
+  // Indexed by layer, then row-major by chunk
+  std::vector<MapChunk> chunks_;
+
+  // Sum of the tilesets' animation frames, so it changes whenever any
+  // tileset's animations advance
+  unsigned int animationFrame_ = 0;
+
+  /**
+   * Gets a render chunk
+   *
+   * @param layer Index of layer
+   * @param x Chunk column
+   * @param y Chunk row
+   * @return Chunk
+   */
+  MapChunk& chunk(const int layer, const int x, const int y) {
+    return chunks_[((std::size_t)layer * chunksHigh_ + y) * chunksWide_ + x];
+  }
+
+  /**
+   * Rebuilds the meshes of a render chunk
+   *
+   * @param layer Index of layer
+   * @param x Chunk column
+   * @param y Chunk row
+   */
+  void buildChunk(const int layer, const int x, const int y);
+
+  /**
+   * Rebuilds out of date chunks on screen and passes each of their meshes
+   * to func in draw order
+   *
+   * @param cameraPos Position of camera
+   * @param func Function to call with each mesh
+   */
+  void visibleMeshes(const sf::Vector2f cameraPos,
+                     const std::function<void(const ChunkMesh&)>& func);
+
+  // Wrap-around texture holding the static tiles of the cells around the
+  // camera. Cell (x, y) lives at (x % cacheTilesWide_, y % cacheTilesHigh_).
+  std::unique_ptr<sf::RenderTexture> scrollCache_;
+  int cacheTilesWide_ = 0;
+  int cacheTilesHigh_ = 0;
+
+  // Cells currently painted into the scroll cache
+  sf::IntRect cachedTiles_;
+
+  // Cells with an animated or diagonally flipped tile on any layer. The
+  // scroll cache leaves them empty and they're drawn on top every frame.
+  // Diagonal tiles are rotated about their top-left corner, so they'd spill
+  // out of their cache slot.
+  std::vector<bool> uncachedCells_;
+
+  /**
+   * Checks whether a cell has an animated or diagonally flipped tile on
+   * any layer
+   *
+   * @param x X coordinate of cell
+   * @param y Y coordinate of cell
+   * @return Whether the cell is left out of the scroll cache
+   */
+  bool cellUncached(const int x, const int y);
+
+  /**
+   * Repaints a cell's slot in the scroll cache
+   *
+   * @param x X coordinate of cell
+   * @param y Y coordinate of cell
+   */
+  void paintCachedCell(const int x, const int y);
+
+  /**
+   * Renders the map through the scroll cache
+   *
+   * @param window Window to render to
+   * @param cameraPos Position of camera to render map relative to
+   */
+  void renderScrollCached(sf::RenderTarget& window,
+                          const sf::Vector2f cameraPos);
+
+  /**
+   * Gets the cells that can be seen on screen from the given camera
+   * position, with a one tile border for rotated tiles drawn outside their
+   * cell
+   *
+   * @param cameraPos Position of camera
+   * @return Visible cells, clamped to the map
+   */
+  sf::IntRect visibleTiles(const sf::Vector2f cameraPos);
+
+  // Compiled maps loaded from disk rather than the archive stay mapped
+  // while their layers read from them
+  std::shared_ptr<MappedFile> mappedFile_;
+
+  /**
+   * Load a map from the given path, either Tiled JSON or a compiled .pmap
    *
    * @param path Path to map file
    * @return Whether operation was successful
@@ -72,35 +442,28 @@ class Map {
   bool load(const std::string& path);
 
   /**
-   * Clamps a point to map dimensions
+   * Reads the tilesets, dimensions and layers of a Tiled JSON map
    *
-   * @param p sf::Vector2f to clamp
+   * @param path Path to map file
+   * @return Whether operation was successful
    */
-  void ensurePointInMap(sf::Vector2f& p);
+  bool loadJson(const std::string& path);
 
   /**
-   * Takes a rectangle in screen space and returns a list of tiles in
-   * map space that the rectangle is touching
+   * Maps a compiled map and reads its tilesets, dimensions and layers,
+   * leaving the layers' tiles in the mapping
    *
-   * @param x X coordinate of rectangle
-   * @param y Y coordinate of rectangle
-   * @param w Width of rectangle
-   * @param h Height of rectangle
-   * @return Set of hit tiles
+   * @param path Path to map file
+   * @return Whether operation was successful
    */
-  std::set<TileId> hitTiles(const float x, const float y, const float w,
-                            const float h);
+  bool loadCompiled(const std::string& path);
 
   /**
-   * Takes a rectangle in screen space and returns a list of tiles in
-   * map space that the rectangle is touching
+   * Clamps a point to map dimensions
    *
-   * @param rect Rectangle to check
-   * @return Set of hit tiles
+   * @param p sf::Vector2f to clamp
    */
-  std::set<TileId> hitTiles(const sf::FloatRect rect) {
-    return hitTiles(rect.left, rect.top, rect.width, rect.height);
-  }
+  void ensurePointInMap(sf::Vector2f& p);
 
   /**
    * Gets the proper tileset for the given tile ID. Necessary because
@@ -122,6 +485,32 @@ class Map {
  public:
   Map(const std::string& path);
 
+  virtual ~Map() {}
+
+  /**
+   * Takes a rectangle in screen space and returns a list of tiles in
+   * map space that the rectangle is touching
+   *
+   * @param x X coordinate of rectangle
+   * @param y Y coordinate of rectangle
+   * @param w Width of rectangle
+   * @param h Height of rectangle
+   * @return Set of hit tiles
+   */
+  virtual std::set<TileId> hitTiles(const float x, const float y,
+                                    const float w, const float h);
+
+  /**
+   * Takes a rectangle in screen space and returns a list of tiles in
+   * map space that the rectangle is touching
+   *
+   * @param rect Rectangle to check
+   * @return Set of hit tiles
+   */
+  std::set<TileId> hitTiles(const sf::FloatRect rect) {
+    return hitTiles(rect.left, rect.top, rect.width, rect.height);
+  }
+
   /**
    * Sets map position to the given point
    *
@@ -140,13 +529,25 @@ class Map {
    */
   void setPosition(const sf::Vector2f pos) { setPosition(pos.x, pos.y); }
 
+  /**
+   * Replaces a tile, keeping collision data up to date
+   *
+   * @param layer Index of layer to change
+   * @param x X coordinate of tile
+   * @param y Y coordinate of tile
+   * @param tile New tile number
+   * @return Whether the operation was successful
+   */
+  virtual bool setTile(const int layer, const int x, const int y,
+                       const TileId tile);
+
   /**
    * Finds position of the next not walkable tile above the rect
    *
    * @param dim Rectangle to test
    * @return Position of next not walkable tile
    */
-  float positionOfTileAbove(const sf::FloatRect dim);
+  virtual float positionOfTileAbove(const sf::FloatRect dim);
 
   /**
    * Finds position of the next not walkable tile below the rect
@@ -154,7 +555,7 @@ class Map {
    * @param dim Rectangle to test
    * @return Position of next not walkable tile
    */
-  float positionOfTileBelow(const sf::FloatRect dim);
+  virtual float positionOfTileBelow(const sf::FloatRect dim);
 
   /**
    * Gets map position
@@ -248,8 +649,8 @@ class Map {
    * @param h Height of rectangle to check
    * @return Whether the rect is walkable
    */
-  bool positionWalkable(const float x, const float y, const float w,
-                        const float h);
+  virtual bool positionWalkable(const float x, const float y, const float w,
+                                const float h);
 
   /**
    * Determines whether or not a position as specified by a rectangle
@@ -262,6 +663,18 @@ class Map {
     return positionWalkable(rect.left, rect.top, rect.width, rect.height);
   }
 
+  /**
+   * Moves a rectangle through the map until it touches a dense tile or the
+   * edge of the map, walking only the cells its leading edges cross. Cells
+   * the rectangle starts in are ignored, so it can always move out of
+   * them.
+   *
+   * @param rect Rectangle to move
+   * @param delta Distance to move the rectangle
+   * @return Fraction of the move that can be made and the normal touched
+   */
+  Sweep sweep(const sf::FloatRect rect, const sf::Vector2f delta);
+
   /**
    * Gets width of map in pixels
    *
@@ -290,12 +703,28 @@ class Map {
    */
   int tileHeight() { return tileHeight_; }
 
+  /**
+   * Gets an estimate of the bytes the map keeps resident, including its
+   * tileset textures and cached meshes
+   *
+   * @return Bytes used
+   */
+  virtual std::size_t memoryUsage();
+
+  /**
+   * Loads and evicts parts of the map around the camera. Plain maps are
+   * always fully resident, so this does nothing.
+   *
+   * @param cameraPos Position of camera
+   */
+  virtual void stream(const sf::Vector2f) {}
+
   /**
    * Updates each tileset
    *
    * @param time Time since last update
    */
-  bool update(const sf::Time& time);
+  virtual bool update(const sf::Time& time);
 
   /**
    * Renders map relative to the given camera position
@@ -303,7 +732,16 @@ class Map {
    * @param window Window to render to
    * @param cameraPos Position of camera to render map relative to
    */
-  void render(sf::RenderTarget& window, const sf::Vector2f cameraPos);
+  virtual void render(sf::RenderTarget& window, const sf::Vector2f cameraPos);
+
+  /**
+   * Adds the map relative to the given camera position to a render snapshot
+   *
+   * @param snapshot Snapshot to add to
+   * @param cameraPos Position of camera to render map relative to
+   */
+  virtual void snapshot(RenderSnapshot& snapshot,
+                        const sf::Vector2f cameraPos);
 };
 
 }  // namespace map
@@ -0,0 +1,124 @@
+#include "mapped_file.h"
+
+#include "log.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile() { close(); }
+
+#ifdef _WIN32
+
+bool MappedFile::open(const std::string& path) {
+  close();
+
+  HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                            nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL,
+                            nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    logger::warning("Unable to open file to map: " + path);
+    return false;
+  }
+  file_ = file;
+
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size)) {
+    logger::warning("Unable to get size of file: " + path);
+    close();
+    return false;
+  }
+  size_ = (std::size_t)size.QuadPart;
+  if (size_ == 0) {
+    // Empty files can't be mapped, but they're still valid files
+    return true;
+  }
+
+  HANDLE mapping =
+      CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (!mapping) {
+    logger::warning("Unable to map file: " + path);
+    close();
+    return false;
+  }
+  mapping_ = mapping;
+
+  data_ = static_cast<const char*>(
+      MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+  if (!data_) {
+    logger::warning("Unable to map file: " + path);
+    close();
+    return false;
+  }
+
+  return true;
+}
+
+void MappedFile::close() {
+  if (data_) {
+    UnmapViewOfFile(data_);
+  }
+  if (mapping_) {
+    CloseHandle(mapping_);
+  }
+  if (file_) {
+    CloseHandle(file_);
+  }
+  data_ = nullptr;
+  mapping_ = nullptr;
+  file_ = nullptr;
+  size_ = 0;
+}
+
+#else
+
+bool MappedFile::open(const std::string& path) {
+  close();
+
+  const int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    logger::warning("Unable to open file to map: " + path);
+    return false;
+  }
+
+  struct stat info;
+  if (fstat(fd, &info) != 0) {
+    logger::warning("Unable to get size of file: " + path);
+    ::close(fd);
+    return false;
+  }
+  size_ = (std::size_t)info.st_size;
+  if (size_ == 0) {
+    // Empty files can't be mapped, but they're still valid files
+    ::close(fd);
+    return true;
+  }
+
+  void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+  // The mapping keeps its own reference to the file
+  ::close(fd);
+  if (data == MAP_FAILED) {
+    logger::warning("Unable to map file: " + path);
+    size_ = 0;
+    return false;
+  }
+  data_ = static_cast<const char*>(data);
+
+  return true;
+}
+
+void MappedFile::close() {
+  if (data_) {
+    munmap(const_cast<char*>(data_), size_);
+  }
+  data_ = nullptr;
+  size_ = 0;
+}
+
+#endif
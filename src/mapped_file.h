@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+/**
+ * Read-only memory mapping of a whole file. Pages are loaded by the OS as
+ * they're touched and can be dropped again under memory pressure.
+ */
+class MappedFile {
+ private:
+  const char* data_ = nullptr;
+  std::size_t size_ = 0;
+
+#ifdef _WIN32
+  void* file_ = nullptr;
+  void* mapping_ = nullptr;
+#endif
+
+ public:
+  MappedFile() {}
+  ~MappedFile();
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  /**
+   * Maps a file, replacing any file already mapped
+   *
+   * @param path Path of file to map
+   * @return Whether the operation was successful
+   */
+  bool open(const std::string& path);
+
+  /**
+   * Unmaps the file. Pointers into it are invalid afterwards.
+   */
+  void close();
+
+  /**
+   * Gets the start of the mapped file
+   *
+   * @return Mapped file contents, or nullptr if nothing is mapped
+   */
+  const char* data() const { return data_; }
+
+  /**
+   * Gets the size of the mapped file
+   *
+   * @return Size in bytes
+   */
+  std::size_t size() const { return size_; }
+};
@@ -0,0 +1,163 @@
+#include "physics.h"
+
+#include "state.h"
+#include "util.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace physics {
+
+// Bodies stepped this tick along with their sprites, the hero first. Kept
+// between steps so stepping doesn't allocate.
+std::vector<entities::Sprite*> sprites_;
+std::vector<entities::Body> bodies_;
+
+// Sprites that touched while moving
+std::vector<std::pair<entities::Sprite*, entities::Sprite*>> contacts_;
+
+/**
+ * Checks whether a sprite fits at bounds without overlapping non-phased
+ * sprites, collecting every sprite it touches there. Tiles are left to
+ * Map::sweep.
+ *
+ * @param sprite Moving sprite
+ * @param bounds Bounds to check
+ * @return Whether the sprite fits
+ */
+static bool fits(entities::Sprite* sprite, const sf::FloatRect& bounds) {
+  bool fits = true;
+  GameState::spriteHash().query(bounds, [&](entities::Sprite* s) {
+    if (s->active() && s != sprite) {
+      contacts_.emplace_back(sprite, s);
+      fits = fits && s->phased();
+    }
+    return true;
+  });
+  if (!fits) {
+    return false;
+  }
+
+  const auto hero = GameState::hero().get();
+  if (sprite != hero && bounds.intersects(hero->getDimensions())) {
+    contacts_.emplace_back(sprite, hero);
+    return sprite->phased();
+  }
+  return true;
+}
+
+/**
+ * Finds the range of tops a sprite can move its top to vertically before
+ * reaching a non-phased sprite. Sprites are only looked for as far as the
+ * move could reach.
+ *
+ * @param sprite Moving sprite
+ * @param dim Current bounds of sprite
+ * @param dy Vertical distance the sprite is moving
+ * @param above Set to the highest top the sprite can reach
+ * @param below Set to the lowest top the sprite can reach
+ * @return Whether a sprite below limits the move
+ */
+static bool spriteLimits(entities::Sprite* sprite, const sf::FloatRect& dim,
+                         const float dy, float& above, float& below) {
+  above = std::numeric_limits<float>::lowest();
+  below = std::numeric_limits<float>::max();
+  bool hasBelow = false;
+
+  const float reach = std::abs(dy) + 1;
+  const sf::FloatRect range(dim.left, dim.top - reach, dim.width,
+                            dim.height + reach * 2);
+  const float bottom = dim.top + dim.height;
+  GameState::spriteHash().query(range, [&](entities::Sprite* s) {
+    if (!s->active() || s->phased() || s == sprite) {
+      return true;
+    }
+    const auto other = s->getDimensions();
+    if (other.top >= bottom) {
+      below = std::min(below, other.top - dim.height);
+      hasBelow = true;
+    } else if (other.top + other.height <= dim.top) {
+      above = std::max(above, other.top + other.height);
+    }
+    return true;
+  });
+  return hasBelow;
+}
+
+void step(const float heroMove) {
+  auto& store = entities::bodies();
+  const auto& map = GameState::map();
+  const auto hero = GameState::hero().get();
+
+  sprites_.clear();
+  sprites_.push_back(hero);
+  for (const auto& sprite : GameState::sprites()) {
+    if (sprite && sprite->active() && !sprite->phased()) {
+      sprites_.push_back(sprite.get());
+    }
+  }
+  bodies_.clear();
+  for (const auto sprite : sprites_) {
+    bodies_.push_back(sprite->body());
+  }
+  contacts_.clear();
+
+  // Falling always counts as jumping so a fall can't be jumped out of
+  const std::size_t count = bodies_.size();
+  for (std::size_t i = 0; i < count; i++) {
+    const auto body = bodies_[i];
+    store.velocityY[body] += entities::GRAVITY;
+    store.flags[body] |= entities::BODY_JUMPING;
+  }
+
+  // Only the hero walks, up to any wall in the way
+  if (heroMove != 0) {
+    auto dim = hero->getDimensions();
+    dim.left += heroMove * map->sweep(dim, sf::Vector2f(heroMove, 0)).time;
+    if (fits(hero, dim)) {
+      hero->setDimensions(dim);
+    }
+  }
+
+  for (std::size_t i = 0; i < count; i++) {
+    const auto sprite = sprites_[i];
+    const auto body = bodies_[i];
+    auto dim = sprite->getDimensions();
+    const float dy = store.velocityY[body];
+
+    // Falls and jumps end on touching a floor or ceiling
+    const auto sweep = map->sweep(dim, sf::Vector2f(0, dy));
+    float top = dim.top + dy * sweep.time;
+    bool stopped = sweep.normal.y != 0;
+    bool landed = sweep.normal.y < 0;
+
+    float above, below;
+    const bool hasBelow = spriteLimits(sprite, dim, dy, above, below);
+    if (util::clamp<float>(top, above, below)) {
+      stopped = true;
+    }
+    landed = landed || (hasBelow && (int)top == (int)below);
+
+    if (stopped) {
+      store.velocityY[body] = 0;
+      store.set(body, entities::BODY_JUMPING, false);
+    }
+    store.set(body, entities::BODY_CAN_JUMP, landed);
+
+    if (top != dim.top) {
+      dim.top = top;
+      if (fits(sprite, dim)) {
+        sprite->setDimensions(dim);
+      }
+    }
+  }
+
+  for (const auto& contact : contacts_) {
+    GameState::addContact(contact.first, contact.second);
+  }
+}
+
+}  // namespace physics
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <SFML/Graphics.hpp>
+
+/**
+ * Moves bodies under gravity and against the map and each other
+ */
+namespace physics {
+
+/**
+ * Moves the hero and every active, non-phased sprite of the current map by
+ * one tick. Velocities of all bodies are integrated first, then moves are
+ * resolved against tiles and sprites one axis at a time. Sprites bumped
+ * into are only passed to GameState::addContact once everything has
+ * moved, so no callbacks run while bodies are moving.
+ *
+ * @param heroMove Horizontal distance the hero walks this tick
+ */
+void step(const float heroMove);
+
+}  // namespace physics
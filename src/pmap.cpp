@@ -0,0 +1,327 @@
+#include "pmap.h"
+
+#include "log.h"
+#include "map.h"
+
+#include <json.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+namespace pmap {
+
+const char MAGIC[4] = {'P', 'M', 'A', 'P'};
+const std::uint16_t VERSION = 1;
+const std::string EXTENSION = ".pmap";
+
+// Planes start on this boundary so they can be read in place
+const std::size_t PLANE_ALIGNMENT = 8;
+
+const std::uint32_t LAYER_NARROW = 1 << 0;
+
+// Highest tile GID a compiled map may use. Maps size a lookup table by
+// their highest GID, so this keeps corrupt files from allocating gigabytes.
+const std::uint32_t MAX_GID = 1 << 20;
+
+// Largest width or height in tiles of a compiled map. Maps keep several
+// per-cell tables, so this keeps corrupt files from allocating gigabytes.
+const std::uint32_t MAX_MAP_TILES = 1 << 12;
+
+// Largest tile width or height in pixels, keeping map pixel sizes in an int
+const std::uint32_t MAX_TILE_PIXELS = 1 << 12;
+
+// Smallest encoding of a tile: a walkable flag and an empty animation
+const std::size_t MIN_TILE_BYTES =
+    sizeof(std::uint8_t) + sizeof(std::uint16_t);
+
+// Smallest encoding of a tileset: five counts and two empty strings
+const std::size_t MIN_TILESET_BYTES =
+    5 * sizeof(std::uint32_t) + 2 * sizeof(std::uint16_t);
+
+/**
+ * Bounds checked reader over the mapped file
+ */
+class Cursor {
+ private:
+  const char* data_;
+  std::size_t size_;
+  std::size_t offset_ = 0;
+
+ public:
+  Cursor(const char* data, const std::size_t size)
+      : data_(data), size_(size) {}
+
+  template <typename T>
+  bool read(T& value) {
+    if (size_ - offset_ < sizeof(value)) {
+      return false;
+    }
+    std::memcpy(&value, data_ + offset_, sizeof(value));
+    offset_ += sizeof(value);
+    return true;
+  }
+
+  bool read(std::string& value) {
+    std::uint16_t length;
+    if (!read(length) || size_ - offset_ < length) {
+      return false;
+    }
+    value.assign(data_ + offset_, length);
+    offset_ += length;
+    return true;
+  }
+
+  bool seek(const std::size_t offset) {
+    if (offset > size_) {
+      return false;
+    }
+    offset_ = offset;
+    return true;
+  }
+
+  std::size_t offset() const { return offset_; }
+
+  std::size_t remaining() const { return size_ - offset_; }
+};
+
+template <typename T>
+static void append(std::string& out, const T& value) {
+  out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+static void append(std::string& out, const std::string& value) {
+  append(out, (std::uint16_t)value.size());
+  out.append(value);
+}
+
+static void pad(std::string& out) {
+  out.resize((out.size() + PLANE_ALIGNMENT - 1) / PLANE_ALIGNMENT *
+             PLANE_ALIGNMENT);
+}
+
+bool isCompiledPath(const std::string& path) {
+  return path.size() >= EXTENSION.size() &&
+         path.compare(path.size() - EXTENSION.size(), EXTENSION.size(),
+                      EXTENSION) == 0;
+}
+
+/**
+ * Reads one entry of the tileset table
+ *
+ * @param cursor Cursor at the start of the entry
+ * @param tileset Filled with the tileset
+ * @return Whether the entry is valid
+ */
+static bool readTileset(Cursor& cursor, map::TilesetDefinition& tileset) {
+  std::uint32_t firstGid, tileCount, columns, tileWidth, tileHeight;
+  if (!cursor.read(firstGid) || !cursor.read(tileCount) ||
+      !cursor.read(columns) || !cursor.read(tileWidth) ||
+      !cursor.read(tileHeight) || !cursor.read(tileset.name) ||
+      !cursor.read(tileset.image)) {
+    return false;
+  }
+  if (columns == 0 || tileWidth == 0 || tileHeight == 0 || firstGid == 0 ||
+      firstGid > MAX_GID || tileCount > MAX_GID - firstGid ||
+      tileCount > cursor.remaining() / MIN_TILE_BYTES) {
+    return false;
+  }
+  tileset.firstGid = firstGid;
+  tileset.tileCount = (int)tileCount;
+  tileset.columns = (int)columns;
+  tileset.tileWidth = (int)tileWidth;
+  tileset.tileHeight = (int)tileHeight;
+
+  tileset.tiles.resize(tileCount);
+  for (auto& tile : tileset.tiles) {
+    std::uint8_t walkable;
+    std::uint16_t animationLength;
+    if (!cursor.read(walkable) || !cursor.read(animationLength)) {
+      return false;
+    }
+    tile.walkable = walkable != 0;
+    tile.frame = 0;
+    tile.animationTiles.resize(animationLength);
+    for (auto& animationTile : tile.animationTiles) {
+      std::uint32_t id;
+      if (!cursor.read(id)) {
+        return false;
+      }
+      animationTile = id;
+    }
+  }
+  return true;
+}
+
+bool read(const char* data, const std::size_t size, CompiledMap& compiled) {
+  Cursor cursor(data, size);
+
+  char magic[4];
+  std::uint16_t version = 0, layerCount = 0;
+  std::uint32_t width, height, tileWidth, tileHeight, tilesetCount,
+      tilesetTableSize;
+  if (!cursor.read(magic) || std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0) {
+    logger::warning("Not a compiled map");
+    return false;
+  }
+  if (!cursor.read(version) || version != VERSION) {
+    logger::warning("Unsupported compiled map version " +
+                    std::to_string(version));
+    return false;
+  }
+  if (!cursor.read(layerCount) || !cursor.read(width) ||
+      !cursor.read(height) || !cursor.read(tileWidth) ||
+      !cursor.read(tileHeight) || !cursor.read(tilesetCount) ||
+      !cursor.read(tilesetTableSize)) {
+    logger::warning("Truncated compiled map header");
+    return false;
+  }
+  if (layerCount == 0 || width == 0 || height == 0 ||
+      width > MAX_MAP_TILES || height > MAX_MAP_TILES || tileWidth == 0 ||
+      tileHeight == 0 || tileWidth > MAX_TILE_PIXELS ||
+      tileHeight > MAX_TILE_PIXELS) {
+    logger::warning("Corrupt compiled map header");
+    return false;
+  }
+
+  if (tilesetTableSize > cursor.remaining() ||
+      tilesetCount > tilesetTableSize / MIN_TILESET_BYTES) {
+    logger::warning("Corrupt compiled map tileset table");
+    return false;
+  }
+
+  const std::size_t tilesetTableEnd = cursor.offset() + tilesetTableSize;
+  compiled.tilesets.resize(tilesetCount);
+  for (auto& tileset : compiled.tilesets) {
+    if (!readTileset(cursor, tileset) || cursor.offset() > tilesetTableEnd) {
+      logger::warning("Corrupt compiled map tileset table");
+      return false;
+    }
+  }
+
+  if (!cursor.seek(tilesetTableEnd)) {
+    logger::warning("Truncated compiled map");
+    return false;
+  }
+
+  const std::size_t cells = (std::size_t)width * height;
+  compiled.layers.resize(layerCount);
+  for (auto& layer : compiled.layers) {
+    std::uint32_t flags, reserved;
+    std::uint64_t offset;
+    if (!cursor.read(flags) || !cursor.read(reserved) ||
+        !cursor.read(offset)) {
+      logger::warning("Truncated compiled map layer table");
+      return false;
+    }
+
+    layer.narrow = (flags & LAYER_NARROW) != 0;
+    const std::size_t bytes =
+        cells * (layer.narrow ? sizeof(std::uint16_t) : sizeof(map::TileId));
+    if (offset % PLANE_ALIGNMENT != 0 || offset > size ||
+        size - offset < bytes) {
+      logger::warning("Corrupt compiled map layer");
+      return false;
+    }
+    layer.plane = data + offset;
+  }
+
+  // Only once every plane is known to hold width * height tiles
+  compiled.width = (int)width;
+  compiled.height = (int)height;
+  compiled.tileWidth = (int)tileWidth;
+  compiled.tileHeight = (int)tileHeight;
+
+  return true;
+}
+
+bool compile(const std::string& jsonPath, const std::string& outPath) {
+  std::ifstream mapfile(jsonPath, std::ios::in);
+  if (!mapfile.is_open()) {
+    logger::error("Unable to open mapfile: " + jsonPath);
+    return false;
+  }
+
+  std::stringstream fileData;
+  fileData << mapfile.rdbuf();
+  mapfile.close();
+
+  const auto mapData = nlohmann::json::parse(fileData.str());
+
+  std::string tilesetTable;
+  for (const auto& tilesetData : mapData["tilesets"]) {
+    const auto tileset = map::readTilesetDefinition(tilesetData);
+    append(tilesetTable, (std::uint32_t)tileset.firstGid);
+    append(tilesetTable, (std::uint32_t)tileset.tileCount);
+    append(tilesetTable, (std::uint32_t)tileset.columns);
+    append(tilesetTable, (std::uint32_t)tileset.tileWidth);
+    append(tilesetTable, (std::uint32_t)tileset.tileHeight);
+    append(tilesetTable, tileset.name);
+    append(tilesetTable, tileset.image);
+    for (const auto& tile : tileset.tiles) {
+      append(tilesetTable, (std::uint8_t)tile.walkable);
+      append(tilesetTable, (std::uint16_t)tile.animationTiles.size());
+      for (const auto animationTile : tile.animationTiles) {
+        append(tilesetTable, (std::uint32_t)animationTile);
+      }
+    }
+  }
+
+  const auto width = mapData["width"].get<std::uint32_t>();
+  const auto height = mapData["height"].get<std::uint32_t>();
+
+  // Compiled layers share the map's dimensions
+  std::vector<map::MapLayer> layers;
+  for (const auto& layerData : mapData["layers"]) {
+    layers.emplace_back(layerData);
+    if ((std::uint32_t)layers.back().width() != width ||
+        (std::uint32_t)layers.back().height() != height) {
+      logger::error(jsonPath + " has a layer that isn't the map's size");
+      return false;
+    }
+  }
+
+  std::string out;
+  out.append(MAGIC, sizeof(MAGIC));
+  append(out, VERSION);
+  append(out, (std::uint16_t)layers.size());
+  append(out, width);
+  append(out, height);
+  append(out, mapData["tilewidth"].get<std::uint32_t>());
+  append(out, mapData["tileheight"].get<std::uint32_t>());
+  append(out, (std::uint32_t)mapData["tilesets"].size());
+
+  // The layer table starts on the next boundary after the tilesets
+  std::size_t tableStart = out.size() + sizeof(std::uint32_t);
+  std::size_t tableEnd = tableStart + tilesetTable.size();
+  tableEnd = (tableEnd + PLANE_ALIGNMENT - 1) / PLANE_ALIGNMENT *
+             PLANE_ALIGNMENT;
+  append(out, (std::uint32_t)(tableEnd - tableStart));
+  out.append(tilesetTable);
+  pad(out);
+
+  std::uint64_t offset = out.size() + layers.size() * 16;
+  for (const auto& layer : layers) {
+    append(out, (std::uint32_t)(layer.narrow() ? LAYER_NARROW : 0));
+    append(out, (std::uint32_t)0);
+    append(out, offset);
+    offset += layer.planeBytes();
+    offset = (offset + PLANE_ALIGNMENT - 1) / PLANE_ALIGNMENT *
+             PLANE_ALIGNMENT;
+  }
+  for (const auto& layer : layers) {
+    out.append(static_cast<const char*>(layer.plane()), layer.planeBytes());
+    pad(out);
+  }
+
+  std::ofstream file(outPath, std::ios::binary | std::ios::trunc);
+  if (!file.is_open()) {
+    logger::error("Unable to write compiled map: " + outPath);
+    return false;
+  }
+  file.write(out.data(), out.size());
+  return (bool)file;
+}
+
+}  // namespace pmap
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "tileset.h"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/**
+ * Compiled map format. A .pmap file holds, in native (little endian) byte
+ * order:
+ *
+ *   header:   "PMAP", u16 version, u16 layer count, u32 width, u32 height,
+ *             u32 tile width, u32 tile height, u32 tileset count,
+ *             u32 tileset table size
+ *   tilesets: per tileset u32 first gid, u32 tile count, u32 columns,
+ *             u32 tile width, u32 tile height, u16 name length, name,
+ *             u16 image length, image, then per tile u8 walkable,
+ *             u16 animation length, u32 animation tiles
+ *   layers:   per layer u32 flags, u32 reserved, u64 plane offset
+ *   planes:   per layer the row-major tiles exactly as MapLayer keeps them,
+ *             each starting on an 8 byte boundary
+ *
+ * Loading maps the file and points the layers at their planes.
+ */
+namespace pmap {
+
+/**
+ * Layer of a compiled map
+ */
+struct Layer {
+  // Whether tiles are 16 bits, see MapLayer
+  bool narrow = false;
+
+  // Points into the mapped file
+  const void* plane = nullptr;
+};
+
+/**
+ * Contents of a compiled map
+ */
+struct CompiledMap {
+  int width = 0;
+  int height = 0;
+  int tileWidth = 0;
+  int tileHeight = 0;
+  std::vector<map::TilesetDefinition> tilesets;
+  std::vector<Layer> layers;
+};
+
+/**
+ * Checks whether a path names a compiled map
+ *
+ * @param path Path to check
+ * @return Whether the path ends in .pmap
+ */
+bool isCompiledPath(const std::string& path);
+
+/**
+ * Reads a compiled map in place
+ *
+ * @param data Contents of the file, 8 byte aligned. Must outlive the layer
+ * planes.
+ * @param size Size of the file
+ * @param compiled Filled with the map's contents
+ * @return Whether the file is a valid compiled map
+ */
+bool read(const char* data, const std::size_t size, CompiledMap& compiled);
+
+/**
+ * Compiles a Tiled JSON map. Tileset image paths are kept as they are, so
+ * the output should sit next to the source.
+ *
+ * @param jsonPath Path of map to compile
+ * @param outPath Path to write compiled map to
+ * @return Whether the operation was successful
+ */
+bool compile(const std::string& jsonPath, const std::string& outPath);
+
+}  // namespace pmap
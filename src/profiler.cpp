@@ -0,0 +1,146 @@
+#include "profiler.h"
+
+#include "log.h"
+
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <mutex>
+#include <vector>
+
+namespace profiler {
+
+typedef std::array<sf::Int64, static_cast<std::size_t>(Phase::COUNT)>
+    FrameTimes;
+
+// Ring buffer of per-frame phase times in microseconds
+std::array<FrameTimes, HISTORY_FRAMES> history_;
+std::size_t next_ = 0;
+std::size_t frames_ = 0;
+
+FrameTimes current_;
+sf::Clock frameClock_;
+
+// Phases are recorded from both the render and simulation threads when
+// running threaded
+std::mutex mutex_;
+
+static std::size_t index(const Phase phase) {
+  return static_cast<std::size_t>(phase);
+}
+
+const char* phaseName(const Phase phase) {
+  switch (phase) {
+    case Phase::EVENTS:
+      return "events";
+    case Phase::SCRIPT:
+      return "script";
+    case Phase::MAP_UPDATE:
+      return "map_update";
+    case Phase::SPRITE_UPDATE:
+      return "sprite_update";
+    case Phase::COLLISIONS:
+      return "collisions";
+    case Phase::PHYSICS:
+      return "physics";
+    case Phase::MAP_RENDER:
+      return "map_render";
+    case Phase::SPRITE_RENDER:
+      return "sprite_render";
+    case Phase::UPSCALE:
+      return "upscale";
+    case Phase::PRESENT:
+      return "present";
+    case Phase::FRAME:
+      return "frame";
+    default:
+      return "unknown";
+  }
+}
+
+void beginFrame() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  current_.fill(0);
+  frameClock_.restart();
+}
+
+void endFrame() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  current_[index(Phase::FRAME)] =
+      frameClock_.getElapsedTime().asMicroseconds();
+  history_[next_] = current_;
+  next_ = (next_ + 1) % HISTORY_FRAMES;
+  frames_ = std::min(frames_ + 1, HISTORY_FRAMES);
+}
+
+void record(const Phase phase, const sf::Time& time) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  current_[index(phase)] += time.asMicroseconds();
+}
+
+std::size_t frames() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return frames_;
+}
+
+PhaseStats stats(const Phase phase) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  PhaseStats result;
+  if (frames_ == 0) {
+    return result;
+  }
+
+  std::vector<sf::Int64> samples;
+  samples.reserve(frames_);
+  sf::Int64 total = 0;
+  for (std::size_t i = 0; i < frames_; i++) {
+    const auto sample = history_[i][index(phase)];
+    samples.push_back(sample);
+    total += sample;
+  }
+
+  const auto p99 = samples.begin() + (samples.size() - 1) * 99 / 100;
+  std::nth_element(samples.begin(), p99, samples.end());
+
+  result.min = sf::microseconds(*std::min_element(samples.begin(), p99 + 1));
+  result.avg = sf::microseconds(total / (sf::Int64)frames_);
+  result.p99 = sf::microseconds(*p99);
+  return result;
+}
+
+bool dumpCsv(const std::string& path) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (frames_ == 0) {
+    return true;
+  }
+
+  std::ofstream csv(path);
+  if (!csv.is_open()) {
+    logger::error("Unable to open profile file: " + path);
+    return false;
+  }
+
+  csv << "frame";
+  for (std::size_t i = 0; i < index(Phase::COUNT); i++) {
+    csv << "," << phaseName(static_cast<Phase>(i)) << "_us";
+  }
+  csv << std::endl;
+
+  // Oldest frame is at next_ once the buffer has wrapped
+  const std::size_t start = frames_ < HISTORY_FRAMES ? 0 : next_;
+  for (std::size_t i = 0; i < frames_; i++) {
+    const auto& frame = history_[(start + i) % HISTORY_FRAMES];
+    csv << i;
+    for (const auto time : frame) {
+      csv << "," << time;
+    }
+    csv << "\n";
+  }
+
+  logger::info("Wrote " + std::to_string(frames_) + " frames of profile to " +
+               path);
+
+  return true;
+}
+
+}  // namespace profiler
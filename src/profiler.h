@@ -0,0 +1,106 @@
+#pragma once
+
+#include <SFML/System.hpp>
+
+#include <string>
+
+namespace profiler {
+
+/**
+ * Parts of a frame that are timed separately
+ */
+enum class Phase : int {
+  EVENTS = 0,
+  SCRIPT = 1,
+  MAP_UPDATE = 2,
+  SPRITE_UPDATE = 3,
+  COLLISIONS = 4,
+  PHYSICS = 5,
+  MAP_RENDER = 6,
+  SPRITE_RENDER = 7,
+  UPSCALE = 8,
+  PRESENT = 9,
+  // Whole frame, from beginFrame() to endFrame()
+  FRAME = 10,
+  COUNT = 11,
+};
+
+// Number of frames kept in the history ring buffer
+const std::size_t HISTORY_FRAMES = 4096;
+
+/**
+ * Summary of a phase's timings over the frame history
+ */
+struct PhaseStats {
+  sf::Time min;
+  sf::Time avg;
+  sf::Time p99;
+};
+
+/**
+ * Gets a short human readable name for a phase
+ *
+ * @param phase Phase to name
+ * @return Name of phase
+ */
+const char* phaseName(const Phase phase);
+
+/**
+ * Starts timing a new frame. Phase timings recorded until the matching
+ * endFrame() are attributed to this frame.
+ */
+void beginFrame();
+
+/**
+ * Finishes the current frame and stores it in the history
+ */
+void endFrame();
+
+/**
+ * Adds time spent in a phase to the current frame. A phase may be recorded
+ * several times per frame (e.g. once per tick) and the times are summed.
+ *
+ * @param phase Phase the time was spent in
+ * @param time Time spent
+ */
+void record(const Phase phase, const sf::Time& time);
+
+/**
+ * Computes min/avg/p99 for a phase over the frame history
+ *
+ * @param phase Phase to compute stats for
+ * @return Stats for the phase
+ */
+PhaseStats stats(const Phase phase);
+
+/**
+ * Gets the number of frames currently in the history
+ *
+ * @return Number of recorded frames
+ */
+std::size_t frames();
+
+/**
+ * Writes the frame history to a CSV file, oldest frame first, with one
+ * column per phase in microseconds
+ *
+ * @param path Path of CSV file to write
+ * @return Whether the operation was successful
+ */
+bool dumpCsv(const std::string& path);
+
+/**
+ * Times the enclosing scope and records it against a phase
+ */
+class ScopedTimer {
+ private:
+  const Phase phase_;
+  sf::Clock clock_;
+
+ public:
+  ScopedTimer(const Phase phase) : phase_(phase) {}
+
+  ~ScopedTimer() { record(phase_, clock_.getElapsedTime()); }
+};
+
+}  // namespace profiler
@@ -2,175 +2,332 @@
 
 #include <SFML/Graphics.hpp>
 
-#include <array>
-#include <experimental/optional>
-#include <utility>
+#include <vector>
 
-namespace detail {
-
-// TODO(jsvana): make this not do crappy new/delete
-
-/*
- * Business logic of the quadtree
+/**
+ * Used for collision detection. Holds values along with their bounding
+ * rectangles and finds the values overlapping an area without checking
+ * every one.
+ *
+ * Values live in the smallest node that fully holds them, so values
+ * straddling quadrant lines sit higher up the tree rather than being
+ * missed. Values outside the tree's bounds live in the root. Nodes and
+ * entries are kept in pools and reused, so once the pools have grown,
+ * inserts, updates, removals and queries don't allocate.
  */
 template <class T>
-struct QuadtreeNode {
+class Quadtree {
  public:
-  const std::size_t MAX_ENTRIES = 4;
+  // Identifies an inserted value, stable until the value is removed
+  typedef int Handle;
 
-  sf::FloatRect dimensions;
+ private:
+  // Entries a leaf holds before it splits
+  const int MAX_ENTRIES = 8;
 
-  bool leaf = true;
+  // Depth below which nodes never split
+  const int MAX_DEPTH = 8;
 
   /*
-   * Structure is:
+   * Children are four consecutive nodes in the pool:
    *
    *   I | II
    * ----+----
    * III | IV
    *
    */
-  std::array<QuadtreeNode<T>*, 4> children;
+  struct Node {
+    sf::FloatRect bounds;
+    int parent = -1;
 
-  std::list<T> entries;
+    // First of the four children, or -1 for leaves. Links free groups.
+    int firstChild = -1;
 
-  QuadtreeNode(sf::FloatRect dim) : dimensions(dim) {}
+    // Entries held directly by this node
+    int firstEntry = -1;
+    int entryCount = 0;
 
-  ~QuadtreeNode() {
-    for (int i = 0; i < 4; i++) {
-      delete children[i];
-    }
+    int depth = 0;
+  };
+
+  struct Entry {
+    T value;
+    sf::FloatRect bounds;
+    int node = -1;
+
+    // Siblings in the node's entry list. next also links free entries.
+    int prev = -1;
+    int next = -1;
+  };
+
+  std::vector<Node> nodes_;
+  std::vector<Entry> entries_;
+
+  // Heads of the free lists
+  int freeNodes_ = -1;
+  int freeEntries_ = -1;
+
+  /**
+   * Checks whether a rectangle lies entirely within another
+   *
+   * @param outer Containing rectangle
+   * @param inner Contained rectangle
+   * @return Whether inner is within outer
+   */
+  static bool contains(const sf::FloatRect& outer,
+                       const sf::FloatRect& inner) {
+    return inner.left >= outer.left && inner.top >= outer.top &&
+           inner.left + inner.width <= outer.left + outer.width &&
+           inner.top + inner.height <= outer.top + outer.height;
   }
 
   /**
-   * Splits node into four quadrants and moves entries into proper quadrants
+   * Finds the child of a node that fully holds a rectangle
+   *
+   * @param node Node to check the children of
+   * @param bounds Rectangle to place
+   * @return Child node or -1 if there are no children or none holds it
    */
-  void split() {
-    auto newDim = dimensions;
-    newDim.width = dimensions.width / 2;
-    newDim.height = dimensions.height / 2;
-    const auto x = dimensions.left;
-    const auto y = dimensions.top;
-
-    children[0] = new QuadtreeNode<T>(newDim);
-    newDim.left = x + newDim.width;
-    children[1] = new QuadtreeNode<T>(newDim);
-    newDim.left = x;
-    newDim.top = y + newDim.height;
-    children[2] = new QuadtreeNode<T>(newDim);
-    newDim.left = x + newDim.width;
-    children[3] = new QuadtreeNode<T>(newDim);
-
-    leaf = false;
-
-    while (!entries.empty()) {
-      auto entry = entries.back();
-      children[quadrant(entry)]->insert(entry);
-      entries.pop_back();
+  int childFor(const int node, const sf::FloatRect& bounds) const {
+    const int first = nodes_[node].firstChild;
+    if (first == -1) {
+      return -1;
     }
+    for (int i = 0; i < 4; i++) {
+      if (contains(nodes_[first + i].bounds, bounds)) {
+        return first + i;
+      }
+    }
+    return -1;
+  }
+
+  void link(const int node, const int entry) {
+    auto& e = entries_[entry];
+    auto& n = nodes_[node];
+    e.node = node;
+    e.prev = -1;
+    e.next = n.firstEntry;
+    if (n.firstEntry != -1) {
+      entries_[n.firstEntry].prev = entry;
+    }
+    n.firstEntry = entry;
+    ++n.entryCount;
+  }
+
+  void unlink(const int entry) {
+    auto& e = entries_[entry];
+    auto& n = nodes_[e.node];
+    if (e.prev != -1) {
+      entries_[e.prev].next = e.next;
+    } else {
+      n.firstEntry = e.next;
+    }
+    if (e.next != -1) {
+      entries_[e.next].prev = e.prev;
+    }
+    --n.entryCount;
+    e.node = -1;
   }
 
   /**
-   * Finds the quadtree quadrant for the value
+   * Splits a leaf into four quadrants and moves down the entries that fit
+   * in one
    *
-   * Here is where we assume T has `getDimensions()`
-   *
-   * @param value Value to find quadrant for
-   * @return Quadrant for value
+   * @param node Leaf to split
    */
-  int quadrant(const T& value) {
-    const auto midX = dimensions.left + dimensions.width / 2;
-    const auto midY = dimensions.top + dimensions.height / 2;
+  void split(const int node) {
+    int first = freeNodes_;
+    if (first != -1) {
+      freeNodes_ = nodes_[first].firstChild;
+    } else {
+      first = (int)nodes_.size();
+      nodes_.resize(nodes_.size() + 4);
+    }
 
-    // TODO(jsvana): pass dimension func to avoid this
-    const auto valueDim = value->getDimensions();
+    const auto bounds = nodes_[node].bounds;
+    const float width = bounds.width / 2;
+    const float height = bounds.height / 2;
+    for (int i = 0; i < 4; i++) {
+      auto& child = nodes_[first + i];
+      child = Node();
+      child.bounds = sf::FloatRect(bounds.left + (i % 2) * width,
+                                   bounds.top + (i / 2) * height, width,
+                                   height);
+      child.parent = node;
+      child.depth = nodes_[node].depth + 1;
+    }
+    nodes_[node].firstChild = first;
 
-    return (valueDim.left >= midX) + (valueDim.top >= midY) * 2;
+    int entry = nodes_[node].firstEntry;
+    while (entry != -1) {
+      const int next = entries_[entry].next;
+      const int child = childFor(node, entries_[entry].bounds);
+      if (child != -1) {
+        unlink(entry);
+        link(child, entry);
+      }
+      entry = next;
+    }
   }
 
   /**
-   * Inserts the given value into the tree, splitting and creating children as
-   * necessary
+   * Places an entry in the smallest node under the given one that holds
+   * it, splitting the node it lands in if that is now too full
    *
-   * @param value Value to insert
+   * @param node Node to start from
+   * @param entry Entry to place
    */
-  void insert(T value) {
-    if (entries.size() == MAX_ENTRIES) {
-      split();
+  void place(int node, const int entry) {
+    int child;
+    while ((child = childFor(node, entries_[entry].bounds)) != -1) {
+      node = child;
     }
+    link(node, entry);
 
-    if (leaf) {
-      entries.push_back(value);
-    } else {
-      children[quadrant(value)]->insert(value);
+    const auto& n = nodes_[node];
+    if (n.firstChild == -1 && n.entryCount > MAX_ENTRIES &&
+        n.depth < MAX_DEPTH) {
+      split(node);
     }
   }
 
   /**
-   * Fetches all entries near the given value
+   * Frees the children of the node and its ancestors while they are all
+   * empty leaves
    *
-   * @param value Value to find entries around
-   * @return List of nearby entities
+   * @param node Node to start from
    */
-  std::list<T> get(const T value) {
-    if (leaf) {
-      return entries;
+  void collapse(int node) {
+    for (; node != -1; node = nodes_[node].parent) {
+      const int first = nodes_[node].firstChild;
+      if (first == -1) {
+        continue;
+      }
+      if (nodes_[node].entryCount > MAX_ENTRIES) {
+        return;
+      }
+      for (int i = 0; i < 4; i++) {
+        const auto& child = nodes_[first + i];
+        if (child.firstChild != -1 || child.entryCount > 0) {
+          return;
+        }
+      }
+      nodes_[node].firstChild = -1;
+      nodes_[first].firstChild = freeNodes_;
+      freeNodes_ = first;
     }
-
-    return children[quadrant(value)]->get(value);
   }
-};
 
-}  // namespace detail
+  template <typename F>
+  bool queryNode(const int node, const sf::FloatRect& range,
+                 F& visit) const {
+    const auto& n = nodes_[node];
+    for (int entry = n.firstEntry; entry != -1;
+         entry = entries_[entry].next) {
+      const auto& e = entries_[entry];
+      if (range.intersects(e.bounds) && !visit(e.value)) {
+        return false;
+      }
+    }
+    if (n.firstChild == -1) {
+      return true;
+    }
+    for (int i = 0; i < 4; i++) {
+      const int child = n.firstChild + i;
+      if (range.intersects(nodes_[child].bounds) &&
+          !queryNode(child, range, visit)) {
+        return false;
+      }
+    }
+    return true;
+  }
 
-/*
- * Used for collision detection.
- * Assumes T has method `getDimensions()` that returns `sf::FloatRect`
- */
-template <class T>
-class Quadtree {
- private:
-  sf::FloatRect dimensions_;
+ public:
+  Quadtree() : Quadtree(sf::FloatRect()) {}
 
-  detail::QuadtreeNode<T>* root_ = nullptr;
+  Quadtree(const sf::FloatRect& bounds) { reset(bounds); }
 
- public:
-  Quadtree(sf::FloatRect dim) : dimensions_(dim) {}
+  /**
+   * Removes every value and sets the area the tree divides, keeping the
+   * pools' memory
+   *
+   * @param bounds Area to divide
+   */
+  void reset(const sf::FloatRect& bounds) {
+    nodes_.resize(1);
+    nodes_[0] = Node();
+    nodes_[0].bounds = bounds;
+    entries_.clear();
+    freeNodes_ = -1;
+    freeEntries_ = -1;
+  }
 
   /**
-   * Clears nodes in the quadtree
+   * Inserts a value
+   *
+   * @param value Value to insert
+   * @param bounds Bounding rectangle of value
+   * @return Handle to update or remove the value with
    */
-  void clear() {
-    if (root_) {
-      delete root_;
+  Handle insert(const T& value, const sf::FloatRect& bounds) {
+    int entry = freeEntries_;
+    if (entry != -1) {
+      freeEntries_ = entries_[entry].next;
+    } else {
+      entry = (int)entries_.size();
+      entries_.emplace_back();
     }
-    root_ = new detail::QuadtreeNode<T>(dimensions_);
+    entries_[entry].value = value;
+    entries_[entry].bounds = bounds;
+    place(0, entry);
+    return entry;
   }
 
   /**
-   * Inserts the given value into the tree, splitting and creating children as
-   * necessary
+   * Moves a value to new bounds. Values that stay within their node are
+   * updated in place.
    *
-   * @param value Value to insert
+   * @param handle Handle of value
+   * @param bounds New bounding rectangle of value
    */
-  void insert(T value) {
-    if (!root_) {
+  void update(const Handle handle, const sf::FloatRect& bounds) {
+    auto& entry = entries_[handle];
+    const int node = entry.node;
+    entry.bounds = bounds;
+    if ((node == 0 || contains(nodes_[node].bounds, bounds)) &&
+        childFor(node, bounds) == -1) {
       return;
     }
 
-    root_->insert(value);
+    unlink(handle);
+    place(0, handle);
+    collapse(node);
   }
 
   /**
-   * Fetches all entries near the given value
+   * Removes a value. Its handle may be given out again.
    *
-   * @param value Value to find entries around
-   * @return List of nearby entities
+   * @param handle Handle of value
    */
-  std::list<T> get(const T value) {
-    if (!root_) {
-      return std::list<T>();
-    }
-    return root_->get(value);
+  void remove(const Handle handle) {
+    const int node = entries_[handle].node;
+    unlink(handle);
+    entries_[handle].value = T();
+    entries_[handle].next = freeEntries_;
+    freeEntries_ = handle;
+    collapse(node);
+  }
+
+  /**
+   * Visits every value whose bounds overlap a range, stopping early if the
+   * visitor returns false. The tree must not be changed while visiting.
+   *
+   * @param range Area to search
+   * @param visit Called with each value found, returns whether to go on
+   * @return Whether every value was visited
+   */
+  template <typename F>
+  bool query(const sf::FloatRect& range, F visit) const {
+    return queryNode(0, range, visit);
   }
 };
@@ -0,0 +1,105 @@
+#include "render_snapshot.h"
+
+#include "constants.h"
+#include "screens/screen.h"
+
+#include <cmath>
+
+void RenderSnapshot::clear() {
+  for (std::size_t i = 0; i < usedBatches_; i++) {
+    batches_[i].texture.reset();
+    batches_[i].vertices.clear();
+    batches_[i].mesh.reset();
+  }
+  usedBatches_ = 0;
+  overlays_.clear();
+  usePrerendered_ = false;
+}
+
+std::vector<sf::Vertex>& RenderSnapshot::quads(
+    const std::shared_ptr<const sf::Texture>& texture) {
+  if (usedBatches_ > 0 && batches_[usedBatches_ - 1].texture == texture &&
+      !batches_[usedBatches_ - 1].mesh) {
+    return batches_[usedBatches_ - 1].vertices;
+  }
+  if (usedBatches_ == batches_.size()) {
+    batches_.emplace_back();
+  }
+  auto& batch = batches_[usedBatches_++];
+  batch.texture = texture;
+  batch.transform = sf::Transform::Identity;
+  return batch.vertices;
+}
+
+void RenderSnapshot::addMesh(
+    const std::shared_ptr<const sf::Texture>& texture,
+    const std::shared_ptr<const std::vector<sf::Vertex>>& mesh,
+    const sf::Transform& transform) {
+  if (usedBatches_ == batches_.size()) {
+    batches_.emplace_back();
+  }
+  auto& batch = batches_[usedBatches_++];
+  batch.texture = texture;
+  batch.mesh = mesh;
+  batch.transform = transform;
+}
+
+void RenderSnapshot::addOverlay(OverlayRenderer overlay) {
+  overlays_.push_back(std::move(overlay));
+}
+
+void RenderSnapshot::prerender(Screen& screen, float interpolation) {
+  if (!prerendered_) {
+    prerendered_ = std::make_unique<sf::RenderTexture>();
+    prerendered_->create(SCREEN_WIDTH, SCREEN_HEIGHT);
+  }
+  prerendered_->clear(sf::Color::Black);
+  screen.render(*prerendered_, interpolation);
+  // Flushes so the render thread's context sees the finished texture
+  prerendered_->display();
+  usePrerendered_ = true;
+}
+
+void RenderSnapshot::render(sf::RenderTarget& target) const {
+  if (usePrerendered_) {
+    target.draw(sf::Sprite(prerendered_->getTexture()));
+    return;
+  }
+
+  for (std::size_t i = 0; i < usedBatches_; i++) {
+    const auto& batch = batches_[i];
+    const auto& vertices = batch.mesh ? *batch.mesh : batch.vertices;
+    if (vertices.empty()) {
+      continue;
+    }
+    sf::RenderStates states;
+    states.texture = batch.texture.get();
+    states.transform = batch.transform;
+    target.draw(&vertices[0], vertices.size(), sf::Quads, states);
+  }
+
+  for (const auto& overlay : overlays_) {
+    overlay(target);
+  }
+}
+
+void appendQuad(std::vector<sf::Vertex>& vertices,
+                const sf::Transform& transform, const sf::IntRect& source) {
+  const float width = (float)std::abs(source.width);
+  const float height = (float)std::abs(source.height);
+
+  const float left = (float)source.left;
+  const float right = left + source.width;
+  const float top = (float)source.top;
+  const float bottom = top + source.height;
+
+  // Same corner layout as sf::Sprite so flipped rects match
+  vertices.emplace_back(transform.transformPoint(sf::Vector2f(0, 0)),
+                        sf::Vector2f(left, top));
+  vertices.emplace_back(transform.transformPoint(sf::Vector2f(width, 0)),
+                        sf::Vector2f(right, top));
+  vertices.emplace_back(transform.transformPoint(sf::Vector2f(width, height)),
+                        sf::Vector2f(right, bottom));
+  vertices.emplace_back(transform.transformPoint(sf::Vector2f(0, height)),
+                        sf::Vector2f(left, bottom));
+}
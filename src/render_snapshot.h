@@ -0,0 +1,109 @@
+#pragma once
+
+#include <SFML/Graphics.hpp>
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+class Screen;
+
+/**
+ * Run of textured quads drawn with a single draw call
+ */
+struct QuadBatch {
+  // Shared so the texture outlives the entity that loaded it for as long
+  // as a snapshot still refers to it
+  std::shared_ptr<const sf::Texture> texture;
+  std::vector<sf::Vertex> vertices;
+
+  // Cached geometry drawn instead of vertices, shared with its owner
+  // rather than copied
+  std::shared_ptr<const std::vector<sf::Vertex>> mesh;
+  sf::Transform transform;
+};
+
+typedef std::function<void(sf::RenderTarget&)> OverlayRenderer;
+
+/**
+ * Immutable description of a frame, built by the simulation and drawn by
+ * the render thread without touching game state.
+ *
+ * Screens that can't describe themselves this way are instead rendered
+ * into the snapshot's own texture on the simulation thread.
+ */
+class RenderSnapshot {
+ private:
+  // Quads in draw order, batched while the texture doesn't change
+  std::vector<QuadBatch> batches_;
+  std::size_t usedBatches_ = 0;
+
+  // UI drawn on top of the quads. Each renderer owns copies of what it
+  // draws.
+  std::vector<OverlayRenderer> overlays_;
+
+  std::unique_ptr<sf::RenderTexture> prerendered_;
+  bool usePrerendered_ = false;
+
+ public:
+  /**
+   * Empties the snapshot, keeping allocations for reuse
+   */
+  void clear();
+
+  /**
+   * Gets the vertex list to append quads using the given texture to. Quads
+   * appended to it are drawn after everything already in the snapshot.
+   *
+   * @param texture Texture the quads sample from
+   * @return Vertex list to append to
+   */
+  std::vector<sf::Vertex>& quads(
+      const std::shared_ptr<const sf::Texture>& texture);
+
+  /**
+   * Adds cached quads, drawn after everything already in the snapshot. The
+   * mesh must not change once added.
+   *
+   * @param texture Texture the quads sample from
+   * @param mesh Quads to draw
+   * @param transform Transform to draw the quads with
+   */
+  void addMesh(const std::shared_ptr<const sf::Texture>& texture,
+               const std::shared_ptr<const std::vector<sf::Vertex>>& mesh,
+               const sf::Transform& transform);
+
+  /**
+   * Adds UI to draw over the quads
+   *
+   * @param overlay Function drawing the UI from its own copy of the state
+   */
+  void addOverlay(OverlayRenderer overlay);
+
+  /**
+   * Renders the screen into the snapshot's texture instead of describing
+   * it. Used for screens that don't support snapshots.
+   *
+   * @param screen Screen to render
+   * @param interpolation Fraction of time between regular updates
+   */
+  void prerender(Screen& screen, float interpolation);
+
+  /**
+   * Draws the snapshot
+   *
+   * @param target Target to draw to
+   */
+  void render(sf::RenderTarget& target) const;
+};
+
+/**
+ * Appends the four vertices of a textured quad
+ *
+ * @param vertices Vertex list to append to
+ * @param transform Transform from the quad's local space (origin at its top
+ * left) to the target
+ * @param source Texture rectangle, negative sizes flip the quad
+ */
+void appendQuad(std::vector<sf::Vertex>& vertices,
+                const sf::Transform& transform, const sf::IntRect& source);
@@ -0,0 +1,235 @@
+#include "replay.h"
+
+#include "log.h"
+
+#include <cstring>
+#include <fstream>
+
+namespace replay {
+
+const char MAGIC[4] = {'P', 'R', 'E', 'C'};
+const sf::Uint16 VERSION = 1;
+
+// Event layouts in the file, kept separate from sf::Event::EventType so
+// SFML renumbering its enum doesn't break old recordings
+enum class EventType : sf::Uint8 {
+  KEY_PRESSED = 0,
+  KEY_RELEASED = 1,
+  TEXT_ENTERED = 2,
+  LOST_FOCUS = 3,
+  GAINED_FOCUS = 4,
+};
+
+// Modifier bits stored with key events
+const sf::Uint8 MOD_ALT = 1 << 0;
+const sf::Uint8 MOD_CONTROL = 1 << 1;
+const sf::Uint8 MOD_SHIFT = 1 << 2;
+const sf::Uint8 MOD_SYSTEM = 1 << 3;
+
+std::ofstream out_;
+std::ifstream in_;
+std::string path_;
+
+template <typename T>
+static void write(const T& value) {
+  out_.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename T>
+static bool read(T& value) {
+  in_.read(reinterpret_cast<char*>(&value), sizeof(value));
+  return (bool)in_;
+}
+
+/**
+ * Converts an event to its type in the file
+ *
+ * @param event Event to convert
+ * @param type Set to the file event type
+ * @return Whether the event is recorded
+ */
+static bool recordedType(const sf::Event& event, EventType& type) {
+  switch (event.type) {
+    case sf::Event::KeyPressed:
+      type = EventType::KEY_PRESSED;
+      return true;
+    case sf::Event::KeyReleased:
+      type = EventType::KEY_RELEASED;
+      return true;
+    case sf::Event::TextEntered:
+      type = EventType::TEXT_ENTERED;
+      return true;
+    case sf::Event::LostFocus:
+      type = EventType::LOST_FOCUS;
+      return true;
+    case sf::Event::GainedFocus:
+      type = EventType::GAINED_FOCUS;
+      return true;
+    default:
+      return false;
+  }
+}
+
+bool startRecording(const std::string& path, const Header& header) {
+  stop();
+
+  out_.open(path, std::ios::binary | std::ios::trunc);
+  if (!out_.is_open()) {
+    logger::error("Unable to open recording: " + path);
+    return false;
+  }
+  path_ = path;
+
+  out_.write(MAGIC, sizeof(MAGIC));
+  write(VERSION);
+  write((sf::Uint32)header.seed);
+  write((sf::Int64)header.tickTime.asMicroseconds());
+  write((sf::Uint8)header.fixedTimestep);
+
+  logger::info("Recording input to " + path);
+  return true;
+}
+
+bool startReplay(const std::string& path, Header& header) {
+  stop();
+
+  in_.open(path, std::ios::binary);
+  if (!in_.is_open()) {
+    logger::error("Unable to open recording: " + path);
+    return false;
+  }
+  path_ = path;
+
+  char magic[sizeof(MAGIC)];
+  in_.read(magic, sizeof(magic));
+  sf::Uint16 version;
+  sf::Uint32 seed;
+  sf::Int64 tickMicroseconds;
+  sf::Uint8 fixedTimestep;
+  if (!in_ || std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 ||
+      !read(version) || version != VERSION || !read(seed) ||
+      !read(tickMicroseconds) || !read(fixedTimestep)) {
+    logger::error("Invalid recording: " + path);
+    in_.close();
+    return false;
+  }
+
+  header.seed = seed;
+  header.tickTime = sf::microseconds(tickMicroseconds);
+  header.fixedTimestep = fixedTimestep != 0;
+
+  logger::info("Replaying input from " + path);
+  return true;
+}
+
+void stop() {
+  if (out_.is_open()) {
+    out_.close();
+    logger::info("Finished recording " + path_);
+  }
+  if (in_.is_open()) {
+    in_.close();
+  }
+}
+
+bool recording() { return out_.is_open(); }
+
+bool replaying() { return in_.is_open(); }
+
+void recordFrame(const sf::Time& elapsed,
+                 const std::vector<sf::Event>& events) {
+  if (!out_.is_open()) {
+    return;
+  }
+
+  sf::Uint16 count = 0;
+  EventType type;
+  for (const auto& event : events) {
+    if (recordedType(event, type)) {
+      ++count;
+    }
+  }
+
+  write((sf::Uint32)elapsed.asMicroseconds());
+  write(count);
+
+  for (const auto& event : events) {
+    if (!recordedType(event, type)) {
+      continue;
+    }
+    write(type);
+    if (type == EventType::KEY_PRESSED || type == EventType::KEY_RELEASED) {
+      sf::Uint8 modifiers = 0;
+      modifiers |= event.key.alt ? MOD_ALT : 0;
+      modifiers |= event.key.control ? MOD_CONTROL : 0;
+      modifiers |= event.key.shift ? MOD_SHIFT : 0;
+      modifiers |= event.key.system ? MOD_SYSTEM : 0;
+      write((sf::Int8)event.key.code);
+      write(modifiers);
+    } else if (type == EventType::TEXT_ENTERED) {
+      write((sf::Uint32)event.text.unicode);
+    }
+  }
+}
+
+bool nextFrame(sf::Time& elapsed, std::vector<sf::Event>& events) {
+  events.clear();
+
+  sf::Uint32 elapsedMicroseconds;
+  sf::Uint16 count;
+  if (!in_.is_open() || !read(elapsedMicroseconds) || !read(count)) {
+    stop();
+    return false;
+  }
+  elapsed = sf::microseconds(elapsedMicroseconds);
+
+  for (sf::Uint16 i = 0; i < count; i++) {
+    EventType type;
+    if (!read(type)) {
+      logger::warning("Recording ends mid-frame: " + path_);
+      stop();
+      return false;
+    }
+
+    sf::Event event;
+    switch (type) {
+      case EventType::KEY_PRESSED:
+      case EventType::KEY_RELEASED: {
+        sf::Int8 code;
+        sf::Uint8 modifiers;
+        read(code);
+        read(modifiers);
+        event.type = type == EventType::KEY_PRESSED ? sf::Event::KeyPressed
+                                                    : sf::Event::KeyReleased;
+        event.key.code = static_cast<sf::Keyboard::Key>(code);
+        event.key.alt = (modifiers & MOD_ALT) != 0;
+        event.key.control = (modifiers & MOD_CONTROL) != 0;
+        event.key.shift = (modifiers & MOD_SHIFT) != 0;
+        event.key.system = (modifiers & MOD_SYSTEM) != 0;
+        break;
+      }
+      case EventType::TEXT_ENTERED: {
+        sf::Uint32 unicode;
+        read(unicode);
+        event.type = sf::Event::TextEntered;
+        event.text.unicode = unicode;
+        break;
+      }
+      case EventType::LOST_FOCUS:
+        event.type = sf::Event::LostFocus;
+        break;
+      case EventType::GAINED_FOCUS:
+        event.type = sf::Event::GainedFocus;
+        break;
+      default:
+        logger::warning("Unknown event in recording: " + path_);
+        stop();
+        return false;
+    }
+    events.push_back(event);
+  }
+
+  return true;
+}
+
+}  // namespace replay
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <SFML/Graphics.hpp>
+
+#include <string>
+#include <vector>
+
+/**
+ * Records the input the engine feeds the screens and plays it back, so a
+ * session can be reproduced exactly for profiling and comparisons.
+ *
+ * A recording is a header followed by one entry per frame holding the frame
+ * time and the events dispatched that frame. Integers are stored in host
+ * byte order.
+ */
+namespace replay {
+
+/**
+ * Settings the simulation must match for a recording to play back the same
+ */
+struct Header {
+  unsigned int seed = 0;
+  sf::Time tickTime;
+  bool fixedTimestep = true;
+};
+
+/**
+ * Starts recording frames to the given file, replacing it
+ *
+ * @param path File to record to
+ * @param header Simulation settings to store
+ * @return Whether the operation was successful
+ */
+bool startRecording(const std::string& path, const Header& header);
+
+/**
+ * Opens a recording for playback
+ *
+ * @param path File to play back
+ * @param header Set to the simulation settings stored in the file
+ * @return Whether the operation was successful
+ */
+bool startReplay(const std::string& path, Header& header);
+
+/**
+ * Finishes any recording or playback in progress
+ */
+void stop();
+
+/**
+ * Gets whether frames are being recorded
+ *
+ * @return Whether recording
+ */
+bool recording();
+
+/**
+ * Gets whether frames are being played back
+ *
+ * @return Whether replaying
+ */
+bool replaying();
+
+/**
+ * Appends a frame to the recording. Only the event types screens respond to
+ * are kept.
+ *
+ * @param elapsed Frame time passed to the simulation
+ * @param events Events dispatched to the screens this frame
+ */
+void recordFrame(const sf::Time& elapsed, const std::vector<sf::Event>& events);
+
+/**
+ * Reads the next recorded frame
+ *
+ * @param elapsed Set to the recorded frame time
+ * @param events Replaced with the recorded events
+ * @return Whether a frame was read, false once the recording is over
+ */
+bool nextFrame(sf::Time& elapsed, std::vector<sf::Event>& events);
+
+}  // namespace replay
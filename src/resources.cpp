@@ -0,0 +1,123 @@
+#include "resources.h"
+
+#include "log.h"
+#include "vfs.h"
+
+#include <mutex>
+#include <unordered_map>
+
+namespace resources {
+
+/**
+ * Cached resource, kept only as long as a handle to it is
+ */
+template <typename T>
+struct Entry {
+  std::weak_ptr<const T> resource;
+  std::size_t bytes = 0;
+};
+
+/**
+ * Font along with the file it was loaded from, which SFML reads glyphs
+ * from for as long as the font lives
+ */
+struct FontData {
+  std::string file;
+  sf::Font font;
+};
+
+std::mutex mutex_;
+std::unordered_map<std::string, Entry<sf::Texture>> textures_;
+std::unordered_map<std::string, Entry<sf::Font>> fonts_;
+
+/**
+ * Totals the live entries of a cache and drops the expired ones
+ *
+ * @param cache Cache to total
+ * @return Live count and bytes
+ */
+template <typename T>
+static Usage usage(std::unordered_map<std::string, Entry<T>>& cache) {
+  Usage total;
+  for (auto it = cache.begin(); it != cache.end();) {
+    if (it->second.resource.expired()) {
+      it = cache.erase(it);
+    } else {
+      ++total.count;
+      total.bytes += it->second.bytes;
+      ++it;
+    }
+  }
+  return total;
+}
+
+std::shared_ptr<const sf::Texture> texture(const std::string& path) {
+  const auto key = vfs::normalize(path);
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  auto& entry = textures_[key];
+  auto cached = entry.resource.lock();
+  if (cached) {
+    return cached;
+  }
+
+  auto loaded = std::make_shared<sf::Texture>();
+  if (!vfs::loadTexture(*loaded, path)) {
+    logger::warning("Unable to load texture: " + path);
+    textures_.erase(key);
+    return loaded;
+  }
+
+  const auto size = loaded->getSize();
+  entry.resource = loaded;
+  entry.bytes = (std::size_t)size.x * size.y * 4;
+  return loaded;
+}
+
+std::shared_ptr<const sf::Font> font(const std::string& path) {
+  const auto key = vfs::normalize(path);
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  auto& entry = fonts_[key];
+  auto cached = entry.resource.lock();
+  if (cached) {
+    return cached;
+  }
+
+  // Fonts in the archive are read in place, others are read into memory
+  // once rather than streamed from the file
+  auto data = std::make_shared<FontData>();
+  const char* file;
+  std::size_t size;
+  if (!vfs::find(path, file, size)) {
+    if (!vfs::readFile(path, data->file)) {
+      data->file.clear();
+    }
+    file = data->file.data();
+    size = data->file.size();
+  }
+
+  // Handles point at the font but keep its file alive with it
+  std::shared_ptr<const sf::Font> loaded(data, &data->font);
+  if (size == 0 || !data->font.loadFromMemory(file, size)) {
+    logger::warning("Unable to load font: " + path);
+    fonts_.erase(key);
+    return loaded;
+  }
+
+  entry.resource = loaded;
+  entry.bytes = size;
+  return loaded;
+}
+
+Usage textureUsage() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return usage(textures_);
+}
+
+Usage fontUsage() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return usage(fonts_);
+}
+
+}  // namespace resources
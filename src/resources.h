@@ -0,0 +1,58 @@
+#pragma once
+
+#include <SFML/Graphics.hpp>
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+/**
+ * Cache of textures and fonts keyed by path. Every request for a path
+ * that's still in use gets the same shared handle, and the resource is
+ * freed when the last handle goes away. Safe to use from any thread.
+ */
+namespace resources {
+
+/**
+ * Live resources of one kind
+ */
+struct Usage {
+  std::size_t count = 0;
+
+  // Textures count 4 bytes a pixel, fonts the size of the font file
+  std::size_t bytes = 0;
+};
+
+/**
+ * Gets the texture at a path, loading it if nothing holds it yet. Textures
+ * that fail to load are returned empty and aren't cached.
+ *
+ * @param path Path of image
+ * @return Shared texture
+ */
+std::shared_ptr<const sf::Texture> texture(const std::string& path);
+
+/**
+ * Gets the font at a path, loading it if nothing holds it yet. Fonts that
+ * fail to load are returned empty and aren't cached.
+ *
+ * @param path Path of font
+ * @return Shared font
+ */
+std::shared_ptr<const sf::Font> font(const std::string& path);
+
+/**
+ * Gets the textures currently held
+ *
+ * @return Texture count and bytes
+ */
+Usage textureUsage();
+
+/**
+ * Gets the fonts currently held
+ *
+ * @return Font count and bytes
+ */
+Usage fontUsage();
+
+}  // namespace resources
@@ -2,6 +2,8 @@
 
 #include "../controls.h"
 #include "../engine.h"
+#include "../physics.h"
+#include "../profiler.h"
 #include "../state.h"
 #include "../util.h"
 #include "../visual/console.h"
@@ -17,48 +19,18 @@ MainScreen::MainScreen() {
   heroHealth_.setDimensions(16, 16, 64, 16);
 
   // Load the game script
-  GameState::chai().eval_file("assets/scripts/game.chai");
+  GameState::useScript("assets/scripts/game.chai");
   GameState::chai().eval<std::function<void()>>("init")();
   GameState::markInitialized();
 
   visual::Console::initialize();
-}
 
-bool MainScreen::fixMovement(const std::unique_ptr<entities::Sprite>& sprite,
-                             sf::Vector2f moveDelta) {
-  auto dim = sprite->getDimensions();
-  const auto oldDim = dim;
-  dim.left += moveDelta.x;
-  if (!GameState::positionWalkable(sprite, dim)) {
-    dim.left = oldDim.left;
-  }
-  if (!GameState::positionWalkable(sprite, dim)) {
-    dim.top = oldDim.top;
-  }
-  // This could probably still cause weirdness
-  sprite->setDimensions(dim);
-  return dim != oldDim;
+  lastCamera_ = GameState::camera();
 }
 
-sf::FloatRect MainScreen::updateGravity(
-    const std::unique_ptr<entities::Sprite>& sprite) {
-  auto dim = sprite->getDimensions();
-  sprite->updateVelocity();
-  const float below = GameState::densePositionBelow(sprite);
-  const float above = GameState::densePositionAbove(sprite);
-  sf::Vector2f jumpDelta(0, sprite->velocity());
-  dim = sprite->getDimensions();
-  float top = dim.top + jumpDelta.y;
-  if (util::clamp<float>(top, above, below)) {
-    sprite->zeroVelocity(true);
-  }
-  if ((int)top == (int)below) {
-    sprite->allowJump();
-  } else {
-    sprite->forbidJump();
-  }
-  dim.top = top;
-  return dim;
+void MainScreen::storePositions() {
+  lastCamera_ = GameState::camera();
+  entities::bodies().storePositions();
 }
 
 void MainScreen::handleEvent(sf::Event& event) {
@@ -73,7 +45,7 @@ void MainScreen::handleEvent(sf::Event& event) {
     if (event.key.code == sf::Keyboard::P) {
       Engine::pushScreen(new PauseMenuScreen());
     } else if (event.key.code == sf::Keyboard::C) {
-      if (sf::Keyboard::isKeyPressed(sf::Keyboard::LControl)) {
+      if (event.key.control) {
         visual::Console::show();
       }
     }
@@ -98,39 +70,61 @@ bool MainScreen::update(sf::Time& time) {
   time_ = time;
   GameState::tick();
 
-  GameState::chai().eval<std::function<void()>>("update")();
-  GameState::map()->update(time_);
-  GameState::hero()->update(time_);
-  heroHealth_.setValue((float)GameState::hero()->hp());
-  for (auto& sprite : GameState::sprites()) {
-    if (!sprite || !sprite->active()) {
-      continue;
-    }
-    sprite->update(time_);
+  storePositions();
+
+  {
+    profiler::ScopedTimer timer(profiler::Phase::SCRIPT);
+    GameState::chai().eval<std::function<void()>>("update")();
+  }
+  {
+    profiler::ScopedTimer timer(profiler::Phase::MAP_UPDATE);
+    GameState::map()->stream(GameState::camera());
+    GameState::map()->update(time_);
+  }
+  {
+    profiler::ScopedTimer timer(profiler::Phase::SPRITE_UPDATE);
+    GameState::hero()->update(time_);
+    heroHealth_.setValue((float)GameState::hero()->hp());
+    for (auto& sprite : GameState::sprites()) {
+      // Sprites can also be marked from callbacks, which deactivates them
+      if (sprite && sprite->needsCleanup()) {
+        GameState::recycleSprite(sprite);
+      }
+      if (!sprite || !sprite->active()) {
+        continue;
+      }
+      sprite->update(time_);
 
-    if (sprite->needsCleanup()) {
-      sprite.reset();
+      if (sprite->needsCleanup()) {
+        GameState::recycleSprite(sprite);
+      }
     }
   }
 
-  GameState::dispatchCollisions();
-
+  // The console and dialogs pause movement
   if (visual::Console::visible()) {
     visual::Console::update(time);
-    return true;
-  }
-
-  if (visual::DialogManager::update(time_)) {
-    return true;
-  } else {
+  } else if (!visual::DialogManager::update(time_)) {
     const auto& dialog = visual::DialogManager::closedDialog();
     if (dialog && dialog->callbackFunc) {
       dialog->callbackFunc(dialog->getChoice());
     }
     visual::DialogManager::clearClosedDialog();
+
+    profiler::ScopedTimer timer(profiler::Phase::PHYSICS);
+    updatePhysics();
+  }
+
+  {
+    profiler::ScopedTimer timer(profiler::Phase::COLLISIONS);
+    GameState::dispatchCollisions();
   }
 
-  auto startDim = GameState::hero()->getDimensions();
+  return true;
+}
+
+void MainScreen::updatePhysics() {
+  const auto startDim = GameState::hero()->getDimensions();
 
   sf::Vector2f moveDelta;
   while (!GameState::moves().empty()) {
@@ -142,7 +136,6 @@ bool MainScreen::update(sf::Time& time) {
       moveDelta.x += GameState::heroMoveSpeed();
     }
   }
-  fixMovement(GameState::hero(), moveDelta);
 
   // Change character direction
   if (moveDelta.x > 0) {
@@ -151,24 +144,14 @@ bool MainScreen::update(sf::Time& time) {
   if (moveDelta.x < 0) {
     GameState::hero()->setDirection(util::Direction::LEFT);
   }
-  if (moveDelta.y > 0) {
-    GameState::hero()->setDirection(util::Direction::DOWN);
-  }
-  if (moveDelta.y < 0) {
-    GameState::hero()->setDirection(util::Direction::UP);
-  }
-
-  auto dim = updateGravity(GameState::hero());
 
-  if (GameState::positionWalkable(GameState::hero(), dim)) {
-    GameState::hero()->setDimensions(dim);
+  physics::step(moveDelta.x);
 
-    GameState::runTileEvent();
-  }
+  GameState::runTileEvent();
 
-  auto currentDim = GameState::hero()->getDimensions();
-  moveDelta.x = currentDim.left - startDim.left;
-  moveDelta.y = currentDim.top - startDim.top;
+  const auto dim = GameState::hero()->getDimensions();
+  moveDelta.x = dim.left - startDim.left;
+  moveDelta.y = dim.top - startDim.top;
 
   // Scrolling
   auto mapPos = GameState::map()->getPosition();
@@ -193,29 +176,25 @@ bool MainScreen::update(sf::Time& time) {
                        GameState::map()->pixelHeight() - (float)SCREEN_HEIGHT);
     GameState::camera().y = y;
   }
-
-  for (const auto& sprite : GameState::sprites()) {
-    if (!sprite || !sprite->active() || sprite->phased()) {
-      continue;
-    }
-    auto dim = updateGravity(sprite);
-    if (GameState::positionWalkable(sprite, dim)) {
-      sprite->setDimensions(dim);
-    }
-  }
-
-  return true;
 }
 
-void MainScreen::render(sf::RenderTarget& window) {
-  GameState::map()->render(window, GameState::camera());
-  for (const auto& sprite : GameState::sprites()) {
-    if (!sprite || !sprite->active()) {
-      continue;
+void MainScreen::render(sf::RenderTarget& window, float interpolation) {
+  const auto camera = interpolatedCamera(interpolation);
+  {
+    profiler::ScopedTimer timer(profiler::Phase::MAP_RENDER);
+    GameState::map()->render(window, camera);
+  }
+  {
+    profiler::ScopedTimer timer(profiler::Phase::SPRITE_RENDER);
+    for (const auto& sprite : GameState::sprites()) {
+      if (!sprite || !sprite->active() ||
+          !sprite->onScreen(camera, interpolation)) {
+        continue;
+      }
+      sprite->render(window, camera, interpolation);
     }
-    sprite->render(window, GameState::camera());
+    GameState::hero()->render(window, camera, interpolation);
   }
-  GameState::hero()->render(window, GameState::camera());
   heroHealth_.render(window);
 
   visual::DialogManager::render(window);
@@ -224,3 +203,33 @@ void MainScreen::render(sf::RenderTarget& window) {
     visual::Console::render(window);
   }
 }
+
+bool MainScreen::snapshot(RenderSnapshot& snapshot, float interpolation) {
+  // Dialogs and the console draw text, which isn't batched into quads
+  if (visual::DialogManager::running() || visual::Console::visible()) {
+    return false;
+  }
+
+  const auto camera = interpolatedCamera(interpolation);
+  {
+    profiler::ScopedTimer timer(profiler::Phase::MAP_RENDER);
+    GameState::map()->snapshot(snapshot, camera);
+  }
+  {
+    profiler::ScopedTimer timer(profiler::Phase::SPRITE_RENDER);
+    for (const auto& sprite : GameState::sprites()) {
+      if (!sprite || !sprite->active() ||
+          !sprite->onScreen(camera, interpolation)) {
+        continue;
+      }
+      sprite->snapshot(snapshot, camera, interpolation);
+    }
+    GameState::hero()->snapshot(snapshot, camera, interpolation);
+  }
+
+  snapshot.addOverlay([health = heroHealth_](sf::RenderTarget& target) mutable {
+    health.render(target);
+  });
+
+  return true;
+}
@@ -32,6 +32,25 @@ class MainScreen : public Screen {
   // Camera to handle player movement
   sf::Vector2f camera_;
 
+  // Camera position at the start of the current tick
+  sf::Vector2f lastCamera_;
+
+  /**
+   * Stores the camera and sprite positions at the start of a tick so
+   * renders can interpolate towards the end of the tick
+   */
+  void storePositions();
+
+  /**
+   * Gets the camera position between the start and end of the current tick
+   *
+   * @param interpolation Fraction of the way through the tick
+   * @return Interpolated camera position
+   */
+  sf::Vector2f interpolatedCamera(const float interpolation) {
+    return lastCamera_ + (GameState::camera() - lastCamera_) * interpolation;
+  }
+
   /**
    * Gets the dimensions in pixels of the camera padding
    *
@@ -44,26 +63,10 @@ class MainScreen : public Screen {
   }
 
   /**
-   * Take a sprite and move it according to moveDelta. If one
-   * component of the move fails, only use the working one.
-   *
-   * If (x, y) fails, try (x, 0) and (0, y). If nothing works
-   * move becomes a no-op.
-   *
-   * @param sprite Sprite to move
-   * @param moveDelta Distance to try to move the sprite
-   * @return Whether the sprite was moved
+   * Moves the hero by the queued moves and every body by gravity, then
+   * scrolls the camera after the hero
    */
-  bool fixMovement(const std::unique_ptr<entities::Sprite>& sprite,
-                   sf::Vector2f moveDelta);
-
-  /**
-   * Takes a sprite and updates its gravity
-   *
-   * @param sprite Sprite to update
-   * @return Updated sprite dimensions
-   */
-  sf::FloatRect updateGravity(const std::unique_ptr<entities::Sprite>& sprite);
+  void updatePhysics();
 
  public:
   MainScreen();
@@ -81,5 +84,10 @@ class MainScreen : public Screen {
   /**
    * @see Screen::render
    */
-  void render(sf::RenderTarget& window);
+  void render(sf::RenderTarget& window, float interpolation);
+
+  /**
+   * @see Screen::snapshot
+   */
+  bool snapshot(RenderSnapshot& snapshot, float interpolation);
 };
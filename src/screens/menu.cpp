@@ -1,6 +1,7 @@
 #include "menu.h"
 
 #include "../constants.h"
+#include "../resources.h"
 #include "../util.h"
 
 #include <SFML/Graphics.hpp>
@@ -8,13 +9,15 @@
 #include <cassert>
 #include <iostream>
 
-MenuScreen::MenuScreen() { font_.loadFromFile("assets/fonts/arcade.ttf"); }
+MenuScreen::MenuScreen() {
+  font_ = resources::font("assets/fonts/arcade.ttf");
+}
 
 void MenuScreen::load() {
   sf::Color titleColor(255, 255, 255);
 
   titleText_.setString(title_);
-  titleText_.setFont(font_);
+  titleText_.setFont(*font_);
   titleText_.setCharacterSize(30);
   titleText_.setFillColor(titleColor);
   auto titleSize = titleText_.getGlobalBounds();
@@ -24,7 +27,7 @@ void MenuScreen::load() {
   for (auto item : items_) {
     sf::Text textItem;
     textItem.setString(item);
-    textItem.setFont(font_);
+    textItem.setFont(*font_);
     textItem.setCharacterSize(20);
     auto itemSize = textItem.getGlobalBounds();
     textItem.setOrigin(itemSize.width / 2, itemSize.height / 2);
@@ -62,7 +65,7 @@ void MenuScreen::handleEvent(sf::Event& event) {
 
 bool MenuScreen::update(sf::Time&) { return running_; }
 
-void MenuScreen::render(sf::RenderTarget& target) {
+void MenuScreen::render(sf::RenderTarget& target, float) {
   const auto targetSize = target.getSize();
 
   target.draw(titleText_);
@@ -21,7 +21,7 @@ class MenuScreen : public Screen {
 
   float PADDING = 10;
 
-  sf::Font font_;
+  std::shared_ptr<const sf::Font> font_;
 
   int selectedItem_ = 0;
 
@@ -58,5 +58,5 @@ class MenuScreen : public Screen {
   /**
    * @see Screen::render
    */
-  void render(sf::RenderTarget& target);
+  void render(sf::RenderTarget& target, float interpolation);
 };
@@ -1,20 +1,21 @@
 #include "opening.h"
 
 #include "../engine.h"
+#include "../resources.h"
 #include "main_screen.h"
 
 #include <iostream>
 
 OpeningScreen::OpeningScreen() {
-  font.loadFromFile("assets/fonts/arcade.ttf");
+  font = resources::font("assets/fonts/arcade.ttf");
 
-  titleText.setFont(font);
+  titleText.setFont(*font);
   titleText.setString("Welcome to Portland!");
   auto titleSize = titleText.getLocalBounds();
   titleText.setCharacterSize(30);
   titleText.setOrigin(titleSize.width / 2, titleSize.height / 2);
 
-  enterText.setFont(font);
+  enterText.setFont(*font);
   enterText.setString("Press Enter to continue");
   enterText.setCharacterSize(15);
   auto enterSize = enterText.getLocalBounds();
@@ -29,7 +30,7 @@ void OpeningScreen::handleEvent(sf::Event& event) {
 
 bool OpeningScreen::update(sf::Time&) { return true; }
 
-void OpeningScreen::render(sf::RenderTarget& target) {
+void OpeningScreen::render(sf::RenderTarget& target, float) {
   auto windowSize = target.getSize();
 
   titleText.setPosition((float)windowSize.x / 2, (float)windowSize.y / 4);
@@ -5,6 +5,7 @@
 
 #include <SFML/Graphics.hpp>
 
+#include <memory>
 #include <string>
 
 /**
@@ -12,7 +13,7 @@
  */
 class OpeningScreen : public Screen {
  private:
-  sf::Font font;
+  std::shared_ptr<const sf::Font> font;
 
   sf::Text titleText;
   sf::Text enterText;
@@ -33,5 +34,5 @@ class OpeningScreen : public Screen {
   /**
    * @see Screen::render
    */
-  void render(sf::RenderTarget& target);
+  void render(sf::RenderTarget& target, float interpolation);
 };
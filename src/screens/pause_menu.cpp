@@ -39,6 +39,6 @@ bool PauseMenuScreen::quit() {
   return running_;
 }
 
-void PauseMenuScreen::render(sf::RenderTarget& target) {
-  MenuScreen::render(target);
+void PauseMenuScreen::render(sf::RenderTarget& target, float interpolation) {
+  MenuScreen::render(target, interpolation);
 }
@@ -46,5 +46,5 @@ class PauseMenuScreen : public MenuScreen {
   /**
    * @see Screen::render
    */
-  void render(sf::RenderTarget& window);
+  void render(sf::RenderTarget& window, float interpolation);
 };
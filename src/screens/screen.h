@@ -1,5 +1,7 @@
 #pragma once
 
+#include "../render_snapshot.h"
+
 #include <SFML/Graphics.hpp>
 
 #include <string>
@@ -21,7 +23,7 @@ class Screen {
   /**
    * Called regularly to update the screen
    *
-   * @param frames Number of frames since start
+   * @param time Time since last update
    * @return Whether the screen is still running
    */
   virtual bool update(sf::Time& time) = 0;
@@ -29,7 +31,18 @@ class Screen {
   /**
    * Renders the screen
    *
+   * @param target Target to render to
+   * @param interpolation Fraction of time between regular updates
+   */
+  virtual void render(sf::RenderTarget& target, float interpolation) = 0;
+
+  /**
+   * Describes the screen for drawing on another thread. Screens that don't
+   * override this are rendered with render() into the snapshot instead.
+   *
+   * @param snapshot Cleared snapshot to fill
    * @param interpolation Fraction of time between regular updates
+   * @return Whether the screen filled the snapshot
    */
-  virtual void render(sf::RenderTarget& target) = 0;
+  virtual bool snapshot(RenderSnapshot&, float) { return false; }
 };
@@ -0,0 +1,225 @@
+#pragma once
+
+#include <SFML/Graphics.hpp>
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Uniform grid of values with bounding rectangles, used to find the values
+ * overlapping an area. Each value is linked into every cell its bounds
+ * touch, and cells are hashed into a fixed set of buckets so the grid
+ * needs no bounds and costs nothing for empty space.
+ *
+ * Moving a value only relinks it when its bounds cross into a different
+ * set of cells. Records and buckets keep their memory when emptied, so
+ * after warming up nothing allocates.
+ */
+template <class T>
+class SpatialHash {
+ public:
+  // Identifies an inserted value, stable until the value is removed
+  typedef int Handle;
+
+ private:
+  struct Record {
+    T value;
+    sf::FloatRect bounds;
+
+    // Cells touched by bounds, inclusive
+    int left = 0;
+    int top = 0;
+    int right = -1;
+    int bottom = -1;
+
+    // Query the record was last visited by, to visit it once per query
+    std::uint32_t stamp = 0;
+
+    // Links free records
+    Handle nextFree = -1;
+  };
+
+  float cellWidth_ = 1;
+  float cellHeight_ = 1;
+
+  // Power of two so hashes can be masked
+  std::vector<std::vector<Handle>> buckets_;
+
+  std::vector<Record> records_;
+  Handle freeRecords_ = -1;
+  std::uint32_t stamp_ = 0;
+
+  int cellX(const float x) const { return (int)std::floor(x / cellWidth_); }
+  int cellY(const float y) const { return (int)std::floor(y / cellHeight_); }
+
+  std::vector<Handle>& bucket(const int x, const int y) {
+    const auto hash =
+        ((std::uint32_t)x * 73856093u) ^ ((std::uint32_t)y * 19349663u);
+    return buckets_[hash & (buckets_.size() - 1)];
+  }
+
+  void link(const Handle handle) {
+    const auto& r = records_[handle];
+    for (int y = r.top; y <= r.bottom; y++) {
+      for (int x = r.left; x <= r.right; x++) {
+        bucket(x, y).push_back(handle);
+      }
+    }
+  }
+
+  void unlink(const Handle handle) {
+    const auto& r = records_[handle];
+    for (int y = r.top; y <= r.bottom; y++) {
+      for (int x = r.left; x <= r.right; x++) {
+        auto& b = bucket(x, y);
+        for (std::size_t i = 0; i < b.size(); i++) {
+          if (b[i] == handle) {
+            b[i] = b.back();
+            b.pop_back();
+            break;
+          }
+        }
+      }
+    }
+  }
+
+  /**
+   * Sets the bounds of a record along with the cells they touch
+   *
+   * @param r Record to set
+   * @param bounds New bounds
+   */
+  void setBounds(Record& r, const sf::FloatRect& bounds) {
+    r.bounds = bounds;
+    r.left = cellX(bounds.left);
+    r.top = cellY(bounds.top);
+    r.right = cellX(bounds.left + bounds.width);
+    r.bottom = cellY(bounds.top + bounds.height);
+  }
+
+ public:
+  SpatialHash() : SpatialHash(1, 1) {}
+
+  /**
+   * @param cellWidth Width of a cell
+   * @param cellHeight Height of a cell
+   * @param bucketCount Number of buckets cells are hashed into, rounded up
+   * to a power of two
+   */
+  SpatialHash(const float cellWidth, const float cellHeight,
+              const std::size_t bucketCount = 4096) {
+    std::size_t count = 1;
+    while (count < bucketCount) {
+      count *= 2;
+    }
+    buckets_.resize(count);
+    reset(cellWidth, cellHeight);
+  }
+
+  /**
+   * Removes every value and sets the cell size, keeping the memory
+   *
+   * @param cellWidth Width of a cell
+   * @param cellHeight Height of a cell
+   */
+  void reset(const float cellWidth, const float cellHeight) {
+    cellWidth_ = cellWidth;
+    cellHeight_ = cellHeight;
+    for (auto& b : buckets_) {
+      b.clear();
+    }
+    records_.clear();
+    freeRecords_ = -1;
+  }
+
+  /**
+   * Inserts a value
+   *
+   * @param value Value to insert
+   * @param bounds Bounding rectangle of value
+   * @return Handle to update or remove the value with
+   */
+  Handle insert(const T& value, const sf::FloatRect& bounds) {
+    Handle handle = freeRecords_;
+    if (handle != -1) {
+      freeRecords_ = records_[handle].nextFree;
+    } else {
+      handle = (Handle)records_.size();
+      records_.emplace_back();
+    }
+    auto& r = records_[handle];
+    r.value = value;
+    r.stamp = stamp_;
+    setBounds(r, bounds);
+    link(handle);
+    return handle;
+  }
+
+  /**
+   * Moves a value to new bounds, relinking it only if it touches different
+   * cells
+   *
+   * @param handle Handle of value
+   * @param bounds New bounding rectangle of value
+   */
+  void update(const Handle handle, const sf::FloatRect& bounds) {
+    auto& r = records_[handle];
+    if (cellX(bounds.left) == r.left && cellY(bounds.top) == r.top &&
+        cellX(bounds.left + bounds.width) == r.right &&
+        cellY(bounds.top + bounds.height) == r.bottom) {
+      r.bounds = bounds;
+      return;
+    }
+    unlink(handle);
+    setBounds(records_[handle], bounds);
+    link(handle);
+  }
+
+  /**
+   * Removes a value. Its handle may be given out again.
+   *
+   * @param handle Handle of value
+   */
+  void remove(const Handle handle) {
+    unlink(handle);
+    auto& r = records_[handle];
+    r.value = T();
+    r.right = r.left - 1;
+    r.nextFree = freeRecords_;
+    freeRecords_ = handle;
+  }
+
+  /**
+   * Visits every value whose bounds overlap a range once, stopping early if
+   * the visitor returns false. The hash must not be changed or queried
+   * again while visiting.
+   *
+   * @param range Area to search
+   * @param visit Called with each value found, returns whether to go on
+   * @return Whether every value was visited
+   */
+  template <typename F>
+  bool query(const sf::FloatRect& range, F visit) {
+    ++stamp_;
+    const int left = cellX(range.left);
+    const int top = cellY(range.top);
+    const int right = cellX(range.left + range.width);
+    const int bottom = cellY(range.top + range.height);
+    for (int y = top; y <= bottom; y++) {
+      for (int x = left; x <= right; x++) {
+        for (const auto handle : bucket(x, y)) {
+          auto& r = records_[handle];
+          if (r.stamp == stamp_) {
+            continue;
+          }
+          r.stamp = stamp_;
+          if (range.intersects(r.bounds) && !visit(r.value)) {
+            return false;
+          }
+        }
+      }
+    }
+    return true;
+  }
+};
@@ -2,12 +2,17 @@
 
 #include "controls.h"
 #include "log.h"
+#include "spatial_hash.h"
+#include "vfs.h"
+#include "world.h"
 
 #include <limits.h>
 
 #include <cmath>
+#include <cstdint>
 #include <ostream>
 #include <random>
+#include <set>
 
 namespace GameState {
 
@@ -31,19 +36,68 @@ std::unordered_map<std::string, int> values_;
 std::unordered_map<std::string, std::list<ValueChangeCallback>>
     valueChangeCallbacks_;
 
+// IDs are a slot index in the low bits and the slot's generation in the
+// high bits. A slot's generation changes whenever its sprite is cleaned up,
+// so IDs held after that no longer match whatever reuses the slot.
+const int ID_INDEX_BITS = 16;
+const entities::Id ID_INDEX_MASK = (1u << ID_INDEX_BITS) - 1;
+
+static entities::Id makeId(const std::size_t index,
+                           const std::uint16_t generation) {
+  return ((entities::Id)generation << ID_INDEX_BITS) | (entities::Id)index;
+}
+
+static std::size_t idIndex(const entities::Id id) { return id & ID_INDEX_MASK; }
+
+static std::uint16_t idGeneration(const entities::Id id) {
+  return (std::uint16_t)(id >> ID_INDEX_BITS);
+}
+
+/**
+ * Sprites of one map. Slot 0 is never used so that ID 0, the hero's, never
+ * finds a sprite.
+ */
+struct SpriteSlots {
+  std::vector<std::unique_ptr<entities::Sprite>> sprites;
+  std::vector<std::uint16_t> generations;
+
+  // Empty slots, reused before growing
+  std::vector<std::size_t> free;
+
+  // Sprites by position, kept up to date by the sprites as they move
+  SpatialHash<entities::Sprite*> hash;
+
+  // Touching pairs by slot, with the hero in the unused slot 0
+  SweepAndPrune broadphase;
+};
+
+// Width and height in tiles of the spatial hash's cells
+const int SPRITE_CELL_TILES = 4;
+
 // Stack is used to mimick maps_
-std::stack<std::vector<std::unique_ptr<entities::Sprite>>> sprites_;
+std::stack<SpriteSlots> sprites_;
+
 
 std::stack<std::unique_ptr<map::Map>> maps_;
 
+// Cleaned up sprites waiting to be reused, by type. Bounded so a burst of
+// sprites doesn't stay allocated forever.
+const std::size_t MAX_POOLED_SPRITES = 256;
+std::vector<std::unique_ptr<entities::Sprite>>
+    spritePools_[static_cast<int>(entities::SpriteType::COUNT)];
+
 std::unordered_map<int, std::tuple<TileCallback, bool>> tileEvents_;
 std::unordered_map<int, TileCallback> tileActions_;
 
-std::default_random_engine generator;
+unsigned int seed_ = std::default_random_engine::default_seed;
+std::default_random_engine generator(seed_);
 std::uniform_int_distribution<int> distribution(0, INT_MAX);
 
 chaiscript::ChaiScript chai_(chaiscript::Std_Lib::library());
 
+// Scripts already run by useScript
+std::set<std::string> usedScripts_;
+
 #define ADD_METHOD(Class, Name) chai_.add(chaiscript::fun(&Class::Name), #Name)
 #define ADD_FUNCTION(Name) ADD_METHOD(GameState, Name)
 #define ADD_TYPE(Type, Name) chai_.add(chaiscript::user_type<Type>(), Name);
@@ -61,6 +115,8 @@ void initApi() {
   ADD_FUNCTION(warning);
   ADD_FUNCTION(error);
 
+  ADD_FUNCTION(useScript);
+
   ADD_FUNCTION(loadMap);
   ADD_FUNCTION(popMap);
   ADD_FUNCTION(loadCharacter);
@@ -82,6 +138,7 @@ void initApi() {
   ADD_FUNCTION(clearEvents);
   ADD_FUNCTION(registerTileEvent);
   ADD_FUNCTION(registerTileAction);
+  ADD_FUNCTION(setTile);
   ADD_FUNCTION(runTileAction);
 
   ADD_TYPE(entities::Sprite, "Sprite");
@@ -102,6 +159,8 @@ void initApi() {
   ADD_METHOD(entities::Sprite, height);
   ADD_METHOD(entities::Sprite, jumping);
   ADD_METHOD(entities::Sprite, setCollisionCallback);
+  ADD_METHOD(entities::Sprite, setCollisionBeginCallback);
+  ADD_METHOD(entities::Sprite, setCollisionEndCallback);
   ADD_METHOD(entities::Sprite, setCleanupCallback);
   ADD_METHOD(entities::Sprite, addItem);
   ADD_METHOD(entities::Sprite, holdingItem);
@@ -172,76 +231,30 @@ void error(const std::string& msg) { logger::error("[SCRIPT] " + msg); }
 
 sf::Vector2f& camera() { return camera_; }
 
-entities::Sprite* spriteCollision(
-    const std::unique_ptr<entities::Sprite>& sprite,
-    const sf::FloatRect& collisionRect) {
-  for (const auto& s : sprites()) {
-    if (!s || !s->active() || s->phased() || s->id == sprite->id) {
-      continue;
-    }
-
-    if (collisionRect.intersects(s->getDimensions())) {
-      return s.get();
+void dispatchCollisions() {
+  // Inactive sprites keep their slot but touch nothing, so their pairs end
+  auto& slots = sprites_.top();
+  for (std::size_t i = 1; i < slots.sprites.size(); i++) {
+    const auto& sprite = slots.sprites[i];
+    if (sprite) {
+      slots.broadphase.set(
+          (int)i, sprite->active() ? sprite->getDimensions() : sf::FloatRect());
     }
   }
-  return nullptr;
-}
-
-float positionOfSpriteAbove(const std::unique_ptr<entities::Sprite>& sprite) {
-  auto dim = sprite->getDimensions();
-  sf::FloatRect collisionRect(dim.left, 0, dim.width, dim.top);
-  const auto other = spriteCollision(sprite, collisionRect);
-  if (other) {
-    const auto oDim = other->getDimensions();
-    return oDim.top + oDim.height;
-  }
-  return 0;
-}
-
-float densePositionAbove(const std::unique_ptr<entities::Sprite>& sprite) {
-  float spriteAbove = positionOfSpriteAbove(sprite);
-  float tileAbove = map()->positionOfTileAbove(sprite->getDimensions());
-  return std::max<float>(spriteAbove, tileAbove);
-}
-
-float positionOfSpriteBelow(const std::unique_ptr<entities::Sprite>& sprite) {
-  auto dim = sprite->getDimensions();
-  sf::FloatRect collisionRect(dim.left, dim.top + dim.height, dim.width,
-                              (float)map()->pixelHeight());
-  const auto other = spriteCollision(sprite, collisionRect);
-  if (other) {
-    const auto oDim = other->getDimensions();
-    return oDim.top - dim.height;
-  }
-  return std::numeric_limits<float>::max();
-}
-
-// TODO(jsvana): make this and Above return the sprite if there is one
-// for collisions
-float densePositionBelow(const std::unique_ptr<entities::Sprite>& sprite) {
-  float spriteBelow = positionOfSpriteBelow(sprite);
-  float tileBelow = map()->positionOfTileBelow(sprite->getDimensions());
-  return std::min<float>(spriteBelow, tileBelow);
-}
-
-void dispatchCollisions() {
-  for (std::size_t i = 0; i < sprites().size(); i++) {
-    const auto sprite1 = sprites()[i].get();
-    if (!sprite1 || !sprite1->active()) {
+  slots.broadphase.set(0, hero()->getDimensions());
+
+  // Callbacks can add sprites, so look them up by slot as they're needed
+  const auto& events = slots.broadphase.step();
+  for (std::size_t i = 0; i < events.size(); i++) {
+    const auto event = events[i];
+    const auto other = slots.sprites[event.b].get();
+    if (!other) {
       continue;
     }
-    const auto dim1 = sprite1->getDimensions();
-    for (std::size_t j = i + 1; j < sprites().size(); j++) {
-      const auto sprite2 = sprites()[j].get();
-      if (!sprite2 || !sprite2->active()) {
-        continue;
-      }
-      if (dim1.intersects(sprite2->getDimensions())) {
-        dispatchCollision(sprite1, sprite2);
-      }
-    }
-    if (dim1.intersects(hero()->getDimensions())) {
-      dispatchCollision(sprite1, hero().get());
+    if (event.a == 0) {
+      dispatchCollision(other, hero().get(), event.phase);
+    } else if (slots.sprites[event.a]) {
+      dispatchCollision(slots.sprites[event.a].get(), other, event.phase);
     }
   }
 }
@@ -253,6 +266,14 @@ int randomNumber(int min, int max) {
   return (distribution(generator) % (max - min)) + min;
 }
 
+void seedRandom(unsigned int seed) {
+  seed_ = seed;
+  generator.seed(seed);
+  distribution.reset();
+}
+
+unsigned int randomSeed() { return seed_; }
+
 void setTicks(util::Tick ticks) { ticks_ = ticks; }
 
 void tick() { ++ticks_; }
@@ -273,20 +294,96 @@ void setHeroMoveSpeed(int amount, int total) {
 
 float heroMoveSpeed() { return moveSpeed_; }
 
-void pushSprites(std::vector<std::unique_ptr<entities::Sprite>> sprites) {
-  sprites_.push(std::move(sprites));
+/**
+ * Empties the sprites of the current map, leaving only the unused slot 0
+ */
+static void clearSprites() {
+  auto& slots = sprites_.top();
+  slots.sprites.clear();
+  slots.generations.clear();
+  slots.free.clear();
+  slots.broadphase.clear();
+  slots.hash.reset((float)(map()->tileWidth() * SPRITE_CELL_TILES),
+                   (float)(map()->tileHeight() * SPRITE_CELL_TILES));
+  slots.sprites.emplace_back();
+  slots.generations.push_back(0);
+}
+
+void pushSprites() {
+  sprites_.emplace();
+  clearSprites();
 }
 
 std::vector<std::unique_ptr<entities::Sprite>>& sprites() {
-  return sprites_.top();
+  return sprites_.top().sprites;
+}
+
+SpatialHash<entities::Sprite*>& spriteHash() { return sprites_.top().hash; }
+
+void addContact(entities::Sprite* a, entities::Sprite* b) {
+  sprites_.top().broadphase.addContact((int)idIndex(a->id),
+                                       (int)idIndex(b->id));
 }
 
 void popSprites() { sprites_.pop(); }
 
+entities::Id allocateSpriteId() {
+  auto& slots = sprites_.top();
+  if (!slots.free.empty()) {
+    const auto index = slots.free.back();
+    slots.free.pop_back();
+    return makeId(index, slots.generations[index]);
+  }
+
+  const auto index = slots.sprites.size();
+  if (index > ID_INDEX_MASK) {
+    logger::error("Too many sprites, limit is " +
+                  std::to_string(ID_INDEX_MASK));
+    return 0;
+  }
+  slots.sprites.emplace_back();
+  slots.generations.push_back(0);
+  return makeId(index, 0);
+}
+
+void recycleSprite(std::unique_ptr<entities::Sprite>& sprite) {
+  auto& slots = sprites_.top();
+  const auto index = idIndex(sprite->id);
+  if (index > 0 && index < slots.sprites.size() &&
+      slots.sprites[index] == sprite) {
+    ++slots.generations[index];
+    slots.free.push_back(index);
+    slots.broadphase.remove((int)index);
+  }
+  sprite->setSpatialHash(nullptr);
+
+  auto& pool = spritePools_[static_cast<int>(sprite->type())];
+  if (pool.size() < MAX_POOLED_SPRITES) {
+    pool.push_back(std::move(sprite));
+  }
+  sprite.reset();
+}
+
 const std::unique_ptr<map::Map>& map() { return maps_.top(); }
 
 chaiscript::ChaiScript& chai() { return chai_; }
 
+bool useScript(std::string path) {
+  if (usedScripts_.count(path) > 0) {
+    return true;
+  }
+
+  std::string script;
+  if (!vfs::readFile(path, script)) {
+    logger::error("Unable to load script: " + path);
+    return false;
+  }
+  usedScripts_.insert(path);
+
+  chai_.eval(script, chaiscript::Exception_Handler(), path);
+  return true;
+}
+
 void addTileEvent(int id, TileCallback callback, bool clearOnFire) {
   tileEvents_[id] = std::make_tuple(callback, clearOnFire);
 }
@@ -333,47 +430,21 @@ void runTileAction() {
   tileAction(tileNumber)();
 }
 
-bool positionWalkable(const std::unique_ptr<entities::Sprite>& sprite,
-                      sf::FloatRect dim) {
-  return positionWalkable(sprite.get(), dim);
-}
-
-bool positionWalkable(entities::Sprite* sprite, sf::FloatRect dim) {
-  if (!map()->positionWalkable(dim)) {
-    return false;
-  }
-
-  // Check sprite walkability
-  for (const auto& s : sprites()) {
-    if (!s || !s->active() || s->id == sprite->id) {
-      continue;
+void dispatchCollision(entities::Sprite* mover, entities::Sprite* other,
+                       const SweepAndPrune::Phase phase) {
+  auto run = [phase](entities::Sprite* sprite, entities::Sprite* against) {
+    if (phase == SweepAndPrune::Phase::BEGIN && sprite->collisionBeginFunc) {
+      sprite->collisionBeginFunc(sprite->id, against->id);
     }
-    sf::FloatRect intersection;
-    if (dim.intersects(s->getDimensions(), intersection)) {
-      dispatchCollision(sprite, s.get());
-      if (!s->phased()) {
-        return false;
-      }
+    if (phase != SweepAndPrune::Phase::END && sprite->collisionFunc) {
+      sprite->collisionFunc(sprite->id, against->id);
     }
-  }
-
-  if (sprite != hero_.get() && dim.intersects(hero_->getDimensions())) {
-    dispatchCollision(sprite, hero_.get());
-    if (!sprite->phased()) {
-      return false;
+    if (phase == SweepAndPrune::Phase::END && sprite->collisionEndFunc) {
+      sprite->collisionEndFunc(sprite->id, against->id);
     }
-  }
-
-  return true;
-}
-
-void dispatchCollision(entities::Sprite* mover, entities::Sprite* other) {
-  if (mover->collisionFunc) {
-    mover->collisionFunc(mover->id, other->id);
-  }
-  if (other->collisionFunc) {
-    other->collisionFunc(other->id, mover->id);
-  }
+  };
+  run(mover, other);
+  run(other, mover);
 }
 
 void markInitialized() { initialized_ = true; }
@@ -391,16 +462,19 @@ bool directionPressed(const int dir) {
 }
 
 bool loadMap(std::string path) {
-  maps_.push(std::make_unique<map::Map>(path));
-  sprites_.emplace();
-  sprites().emplace_back();
+  if (map::isWorldPath(path)) {
+    maps_.push(std::make_unique<map::World>(path));
+  } else {
+    maps_.push(std::make_unique<map::Map>(path));
+  }
+  pushSprites();
 
   return true;
 }
 
 bool popMap() {
   maps_.pop();
-  sprites_.pop();
+  popSprites();
 
   return true;
 }
@@ -437,36 +511,57 @@ bool setCharacterMaxHp(int hp) {
 }
 
 template <typename T>
-entities::Id addSprite(const std::string& path, float x, float y) {
-  sprites().push_back(std::make_unique<T>(path));
-  auto item = sprites().back().get();
-  item->setPosition(x * GameState::map()->tileWidth(),
+entities::Id addSprite(const std::string& path,
+                       const entities::SpriteType type, float x, float y) {
+  const auto spriteId = allocateSpriteId();
+  if (spriteId == 0) {
+    return 0;
+  }
+  auto& slot = sprites()[idIndex(spriteId)];
+
+  const auto prototype = entities::prototype(path);
+  auto& pool = spritePools_[static_cast<int>(type)];
+  if (pool.empty()) {
+    slot = std::make_unique<T>(prototype);
+  } else {
+    pool.back()->reset(prototype);
+    slot = std::move(pool.back());
+    pool.pop_back();
+  }
+  slot->setPosition(x * GameState::map()->tileWidth(),
                     y * GameState::map()->tileHeight());
-
-  const auto spriteId = sprites().size() - 1;
-  item->id = spriteId;
+  slot->id = spriteId;
+  slot->setSpatialHash(&sprites_.top().hash);
   return spriteId;
 }
 
 entities::Id addItem(const std::string& path, float x, float y) {
-  return addSprite<entities::Item>(path, x, y);
+  return addSprite<entities::Item>(path, entities::SpriteType::ITEM, x, y);
 }
 
 entities::Id addNpc(const std::string& path, float x, float y) {
-  return addSprite<entities::Npc>(path, x, y);
+  return addSprite<entities::Npc>(path, entities::SpriteType::NPC, x, y);
 }
 
 entities::Id addProjectile(const std::string& path, float x, float y) {
-  return addSprite<entities::Projectile>(path, x, y);
+  return addSprite<entities::Projectile>(path, entities::SpriteType::PROJECTILE,
+                                         x, y);
 }
 
 template <typename T>
 T* findSprite(const entities::Id spriteId) {
-  if (spriteId >= sprites().size()) {
-    logger::warning("Bad sprite ID: " + spriteId);
+  const auto& slots = sprites_.top();
+  const auto index = idIndex(spriteId);
+  if (index >= slots.sprites.size()) {
+    logger::warning("Bad sprite ID: " + std::to_string(spriteId));
+    return nullptr;
+  }
+
+  // IDs of cleaned up sprites fail quietly, scripts check with spriteNull
+  if (slots.generations[index] != idGeneration(spriteId)) {
     return nullptr;
   }
-  return static_cast<T*>(sprites()[spriteId].get());
+  return static_cast<T*>(slots.sprites[index].get());
 }
 
 template <typename T>
@@ -475,11 +570,11 @@ T* findSprite(const entities::Id spriteId, const entities::SpriteType type) {
   if (!sprite) {
     return nullptr;
   }
-  if (sprites()[spriteId]->type() != type) {
-    logger::warning(
-        "ID " + std::to_string(spriteId) + " is incorrect type " +
-        std::to_string(static_cast<int>(type)) + " (wanted type " +
-        std::to_string(static_cast<int>(sprites()[spriteId]->type())) + ")");
+  if (sprite->type() != type) {
+    logger::warning("ID " + std::to_string(spriteId) + " is incorrect type " +
+                    std::to_string(static_cast<int>(sprite->type())) +
+                    " (wanted type " + std::to_string(static_cast<int>(type)) +
+                    ")");
     return nullptr;
   }
   return sprite;
@@ -541,6 +636,10 @@ bool registerTileAction(int x, int y, TileCallback callback) {
   return true;
 }
 
+bool setTile(int layer, int x, int y, int tile) {
+  return map()->setTile(layer, x, y, (map::TileId)tile);
+}
+
 bool clearEvents() {
   clearTileEvents();
   return true;
@@ -608,14 +707,16 @@ bool save(const std::string& path) {
   nlohmann::json gameState;
   gameState["hero"] = hero()->serialize();
 
-  nlohmann::json savedSprites;
+  auto savedSprites = nlohmann::json::array();
   for (const auto& sprite : sprites()) {
     if (!sprite) {
       continue;
     }
-    savedSprites[sprite->id] = sprite->serialize();
+    savedSprites.push_back(sprite->serialize());
   }
   gameState["sprites"] = savedSprites;
+  // Free slots too, so IDs of sprites already cleaned up stay stale
+  gameState["generations"] = sprites_.top().generations;
   gameState["flags"] = flags_;
   gameState["values"] = values_;
 
@@ -653,8 +754,21 @@ bool load(const std::string& path) {
       heroData.find("path")->second.get<std::string>());
   hero_->deserialize(heroData);
 
-  sprites().clear();
-  sprites().emplace_back();
+  // Sprites go back in the slots their IDs name so IDs held by scripts
+  // stay valid. Older saves hold null gaps, which are skipped.
+  clearSprites();
+  auto& slots = sprites_.top();
+  const auto savedGenerations = saveData.find("generations");
+  if (savedGenerations != saveData.end()) {
+    auto generations = savedGenerations->get<std::vector<std::uint16_t>>();
+    if (generations.size() > ID_INDEX_MASK + 1) {
+      generations.resize(ID_INDEX_MASK + 1);
+    }
+    if (generations.size() > slots.generations.size()) {
+      slots.sprites.resize(generations.size());
+      slots.generations = generations;
+    }
+  }
   for (const auto& spriteData :
        saveData["sprites"].get<std::vector<nlohmann::json>>()) {
     if (spriteData.is_null()) {
@@ -663,21 +777,41 @@ bool load(const std::string& path) {
     const auto spritePath = spriteData["path"].get<std::string>();
     const auto spriteType = static_cast<entities::SpriteType>(
         spriteData["type"].get<entities::Id>());
+    std::unique_ptr<entities::Sprite> sprite;
     switch (spriteType) {
       case entities::SpriteType::NPC:
-        sprites().push_back(std::make_unique<entities::Npc>(spritePath));
+        sprite = std::make_unique<entities::Npc>(spritePath);
         break;
       case entities::SpriteType::ITEM:
-        sprites().push_back(std::make_unique<entities::Item>(spritePath));
+        sprite = std::make_unique<entities::Item>(spritePath);
         break;
       case entities::SpriteType::PROJECTILE:
-        sprites().push_back(std::make_unique<entities::Projectile>(spritePath));
+        sprite = std::make_unique<entities::Projectile>(spritePath);
         break;
       default:
-        sprites().push_back(std::make_unique<entities::Sprite>(spritePath));
+        sprite = std::make_unique<entities::Sprite>(spritePath);
         break;
     }
-    sprites().back()->deserialize(spriteData);
+    sprite->deserialize(spriteData);
+
+    const auto index = idIndex(sprite->id);
+    if (index == 0 || (index < slots.sprites.size() && slots.sprites[index])) {
+      logger::warning("Skipping saved sprite with bad ID " +
+                      std::to_string(sprite->id));
+      continue;
+    }
+    if (index >= slots.sprites.size()) {
+      slots.sprites.resize(index + 1);
+      slots.generations.resize(index + 1, 0);
+    }
+    slots.generations[index] = idGeneration(sprite->id);
+    sprite->setSpatialHash(&slots.hash);
+    slots.sprites[index] = std::move(sprite);
+  }
+  for (std::size_t i = slots.sprites.size() - 1; i > 0; i--) {
+    if (!slots.sprites[i]) {
+      slots.free.push_back(i);
+    }
   }
   flags_.clear();
   for (const auto& p :
@@ -6,6 +6,7 @@
 #include "entities/projectile.h"
 #include "entities/sprite.h"
 #include "map.h"
+#include "sweep_and_prune.h"
 #include "visual/dialog.h"
 
 #include <chaiscript/chaiscript.hpp>
@@ -75,47 +76,10 @@ void warning(const std::string& msg);
 void error(const std::string& msg);
 
 /**
- * Finds a sprite that collides with the given rectangle
- *
- * @param collisionRect Rectangle to check
- * @return Sprite colliding or nullptr
- */
-entities::Sprite* spriteCollision(const sf::FloatRect& collisionRect);
-
-/**
- * Finds position of the next sprite above the sprite
- *
- * @param sprite Sprite to check
- * @return Position of next sprite
- */
-float positionOfSpriteAbove(const std::unique_ptr<entities::Sprite>& sprite);
-
-/**
- * Finds position of the next dense object above the sprite
- *
- * @param sprite Sprite to check
- * @return Position of next dense object
- */
-float densePositionAbove(const std::unique_ptr<entities::Sprite>& sprite);
-
-/**
- * Finds position of the next sprite below the sprite
- *
- * @param sprite Sprite to check
- * @return Position of next sprite
- */
-float positionOfSpriteBelow(const std::unique_ptr<entities::Sprite>& sprite);
-
-/**
- * Finds position of the next dense object below the sprite
- *
- * @param sprite Sprite to check
- * @return Position of next dense object
- */
-float densePositionBelow(const std::unique_ptr<entities::Sprite>& sprite);
-
-/**
- * Check all entities for collisions and dispatch appropriately
+ * Finds which entities touch, including contacts added and blocked moves
+ * seen by physics::step since the last call, and runs the collision
+ * callbacks of each pair that began, persisted or ended touching. Each
+ * pair's callbacks run once per call.
  */
 void dispatchCollisions();
 
@@ -145,6 +109,20 @@ int iabs(int a);
  */
 int randomNumber(int min, int max);
 
+/**
+ * Reseeds the random number generator used by randomNumber()
+ *
+ * @param seed New seed
+ */
+void seedRandom(unsigned int seed);
+
+/**
+ * Gets the seed the random number generator was last seeded with
+ *
+ * @return Current seed
+ */
+unsigned int randomSeed();
+
 /**
  * Advance ticks by one
  */
@@ -186,20 +164,48 @@ entities::Sprite* getHero();
 float heroMoveSpeed();
 
 /**
- * Increments the internal sprite ID counter and returns the previous
- * value
+ * Reserves an empty slot in the current map's sprites, reusing the slot of
+ * a cleaned up sprite when there is one
  *
- * @return Next sprite ID
+ * @return ID for the slot, or 0 if the sprite limit is reached
  */
 entities::Id allocateSpriteId();
 
 /**
- * Gets a reference to the topmost sprite map
+ * Gets a reference to the topmost sprite map. Slots are indexed by the low
+ * bits of sprite IDs and are empty for cleaned up sprites, so look sprites
+ * up by ID with getSprite rather than indexing directly.
  *
  * @return Reference to topmost sprite map
  */
 std::vector<std::unique_ptr<entities::Sprite>>& sprites();
 
+/**
+ * Gets the spatial hash of the topmost sprite map's sprites. The hero is
+ * not in it.
+ *
+ * @return Spatial hash of sprites
+ */
+SpatialHash<entities::Sprite*>& spriteHash();
+
+/**
+ * Counts two sprites as touching in the next dispatchCollisions even if
+ * they don't overlap, like when one's move was blocked by the other
+ *
+ * @param a First sprite
+ * @param b Second sprite
+ */
+void addContact(entities::Sprite* a, entities::Sprite* b);
+
+/**
+ * Moves a cleaned up sprite into the pool for its type so a later add can
+ * reuse it. Its slot is left empty for reuse, and its ID stops finding
+ * anything.
+ *
+ * @param sprite Sprite to recycle
+ */
+void recycleSprite(std::unique_ptr<entities::Sprite>& sprite);
+
 /**
  * Gets the topmost map
  *
@@ -214,6 +220,16 @@ const std::unique_ptr<map::Map>& map();
  */
 chaiscript::ChaiScript& chai();
 
+/**
+ * Runs a script unless it has already been run, reading it from the asset
+ * archive if one is mounted. Replaces ChaiScript's use(), which only reads
+ * from disk.
+ *
+ * @param path Path of script
+ * @return Whether the script was found
+ */
+bool useScript(std::string path);
+
 /**
  * Adds a callback to a specific tile
  *
@@ -274,31 +290,15 @@ void clearTileEvent(int id);
 void clearTileEvents();
 
 /**
- * Checks if a position is walkable by a given entity ID
- *
- * @param sprite Moving entity
- * @param dim Rectangle to check
- * @return Whether position is walkable
- */
-bool positionWalkable(const std::unique_ptr<entities::Sprite>& sprite,
-                      sf::FloatRect dim);
-
-/**
- * Checks if a position is walkable by a given entity ID
- *
- * @param sprite Moving entity
- * @param dim Rectangle to check
- * @return Whether position is walkable
- */
-bool positionWalkable(entities::Sprite* sprite, sf::FloatRect dim);
-
-/**
- * Attempts to run collision callback on `mover` against `other`
+ * Attempts to run collision callbacks on `mover` against `other` and on
+ * `other` against `mover`
  *
  * @param mover Sprite to run callback on
  * @param other Sprite to run callback against
+ * @param phase Whether the sprites began, kept or stopped touching
  */
-void dispatchCollision(entities::Sprite* mover, entities::Sprite* other);
+void dispatchCollision(entities::Sprite* mover, entities::Sprite* other,
+                       const SweepAndPrune::Phase phase);
 
 /**
  * Checks for an event on the character's current tile, runs the event, and
@@ -347,7 +347,8 @@ std::queue<util::Direction>& moves();
 bool directionPressed(const int dir);
 
 /**
- * Loads a new map and pushes it onto the stack
+ * Loads a new map and pushes it onto the stack. Paths ending in .world
+ * load a streaming world of rooms instead.
  *
  * @param path Path of new map to load
  * @return Whether the operation is successful
@@ -536,6 +537,17 @@ bool registerTileEvent(int x, int y, TileCallback callback, bool clearOnFire);
  */
 bool registerTileAction(int x, int y, TileCallback callback);
 
+/**
+ * Replaces a tile in the current map
+ *
+ * @param layer Index of layer to change
+ * @param x X coordinate of tile
+ * @param y Y coordinate of tile
+ * @param tile New tile number, or 0 to clear the tile
+ * @return Whether the operation is successful
+ */
+bool setTile(int layer, int x, int y, int tile);
+
 /**
  * Clears all registered tile events
  *
@@ -0,0 +1,119 @@
+#include "sweep_and_prune.h"
+
+#include <algorithm>
+
+std::uint64_t SweepAndPrune::pairKey(int a, int b) {
+  if (a > b) {
+    std::swap(a, b);
+  }
+  return ((std::uint64_t)a << 32) | (std::uint32_t)b;
+}
+
+void SweepAndPrune::dropPairs(std::vector<std::uint64_t>& pairs,
+                              const int key) {
+  pairs.erase(std::remove_if(pairs.begin(), pairs.end(),
+                             [key](const std::uint64_t pair) {
+                               return (int)(pair >> 32) == key ||
+                                      (int)(std::uint32_t)pair == key;
+                             }),
+              pairs.end());
+}
+
+void SweepAndPrune::clear() {
+  boxes_.clear();
+  order_.clear();
+  pairs_.clear();
+  found_.clear();
+  contacts_.clear();
+  compactContactsAt_ = 64;
+  events_.clear();
+}
+
+void SweepAndPrune::set(const int key, const sf::FloatRect& bounds) {
+  if (key >= (int)boxes_.size()) {
+    boxes_.resize(key + 1);
+  }
+  auto& box = boxes_[key];
+  box.bounds = bounds;
+  if (!box.present) {
+    box.present = true;
+    order_.push_back(key);
+  }
+}
+
+void SweepAndPrune::remove(const int key) {
+  if (key >= (int)boxes_.size() || !boxes_[key].present) {
+    return;
+  }
+  boxes_[key].present = false;
+  order_.erase(std::find(order_.begin(), order_.end(), key));
+  dropPairs(pairs_, key);
+  dropPairs(contacts_, key);
+}
+
+void SweepAndPrune::addContact(const int a, const int b) {
+  if (a == b) {
+    return;
+  }
+  contacts_.push_back(pairKey(a, b));
+  if (contacts_.size() >= compactContactsAt_) {
+    std::sort(contacts_.begin(), contacts_.end());
+    contacts_.erase(std::unique(contacts_.begin(), contacts_.end()),
+                    contacts_.end());
+    compactContactsAt_ = std::max<std::size_t>(64, contacts_.size() * 2);
+  }
+}
+
+const std::vector<SweepAndPrune::Event>& SweepAndPrune::step() {
+  // Insertion sort, nearly linear since the order is kept between steps
+  for (std::size_t i = 1; i < order_.size(); i++) {
+    const int key = order_[i];
+    const float left = boxes_[key].bounds.left;
+    std::size_t j = i;
+    while (j > 0 && boxes_[order_[j - 1]].bounds.left > left) {
+      order_[j] = order_[j - 1];
+      --j;
+    }
+    order_[j] = key;
+  }
+
+  // Sweep along x, only checking boxes whose x ranges overlap
+  found_.clear();
+  for (std::size_t i = 0; i < order_.size(); i++) {
+    const auto& a = boxes_[order_[i]].bounds;
+    const float right = a.left + a.width;
+    for (std::size_t j = i + 1; j < order_.size(); j++) {
+      const auto& b = boxes_[order_[j]].bounds;
+      if (b.left >= right) {
+        break;
+      }
+      if (a.intersects(b)) {
+        found_.push_back(pairKey(order_[i], order_[j]));
+      }
+    }
+  }
+  found_.insert(found_.end(), contacts_.begin(), contacts_.end());
+  contacts_.clear();
+  std::sort(found_.begin(), found_.end());
+  found_.erase(std::unique(found_.begin(), found_.end()), found_.end());
+
+  // Both lists are sorted, so walk them together
+  events_.clear();
+  auto addEvent = [this](const std::uint64_t pair, const Phase phase) {
+    events_.push_back({(int)(pair >> 32), (int)(std::uint32_t)pair, phase});
+  };
+  std::size_t i = 0, j = 0;
+  while (i < pairs_.size() || j < found_.size()) {
+    if (j == found_.size() || (i < pairs_.size() && pairs_[i] < found_[j])) {
+      addEvent(pairs_[i++], Phase::END);
+    } else if (i == pairs_.size() || found_[j] < pairs_[i]) {
+      addEvent(found_[j++], Phase::BEGIN);
+    } else {
+      addEvent(found_[j++], Phase::PERSIST);
+      ++i;
+    }
+  }
+  pairs_.swap(found_);
+
+  return events_;
+}
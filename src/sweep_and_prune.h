@@ -0,0 +1,105 @@
+#pragma once
+
+#include <SFML/Graphics.hpp>
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * Sweep-and-prune broadphase that tracks which boxes touch from one step to
+ * the next. Boxes are keyed by small non-negative integers.
+ *
+ * The boxes stay sorted by left edge between steps. Things move little
+ * from one step to the next, so re-sorting with insertion sort is close to
+ * linear. Each step reports every touching pair exactly once: as beginning,
+ * persisting or ending.
+ */
+class SweepAndPrune {
+ public:
+  enum class Phase {
+    BEGIN,
+    PERSIST,
+    END,
+  };
+
+  /**
+   * Change in a pair of boxes touching, with a < b
+   */
+  struct Event {
+    int a;
+    int b;
+    Phase phase;
+  };
+
+ private:
+  struct Box {
+    sf::FloatRect bounds;
+    bool present = false;
+  };
+
+  // By key
+  std::vector<Box> boxes_;
+
+  // Keys of present boxes sorted by left edge
+  std::vector<int> order_;
+
+  // Pairs touching as of the last step and found in this step, sorted
+  std::vector<std::uint64_t> pairs_;
+  std::vector<std::uint64_t> found_;
+
+  // Pairs to count as touching in the next step even if they don't overlap,
+  // and the size at which to drop repeats so they can't pile up
+  std::vector<std::uint64_t> contacts_;
+  std::size_t compactContactsAt_ = 64;
+
+  std::vector<Event> events_;
+
+  static std::uint64_t pairKey(int a, int b);
+
+  /**
+   * Drops every pair including a key from a list, keeping its order
+   *
+   * @param pairs List to drop from
+   * @param key Key to drop pairs of
+   */
+  static void dropPairs(std::vector<std::uint64_t>& pairs, const int key);
+
+ public:
+  /**
+   * Removes every box and pair, keeping the memory
+   */
+  void clear();
+
+  /**
+   * Adds a box or moves an existing one. Empty boxes touch nothing, so
+   * their pairs end on the next step.
+   *
+   * @param key Key of box
+   * @param bounds New bounds of box
+   */
+  void set(const int key, const sf::FloatRect& bounds);
+
+  /**
+   * Removes a box. Its pairs are dropped without ending, so the key can be
+   * reused for a new box right away.
+   *
+   * @param key Key of box
+   */
+  void remove(const int key);
+
+  /**
+   * Counts two boxes as touching in the next step, for things that met
+   * without overlapping, like a move that was blocked
+   *
+   * @param a Key of first box
+   * @param b Key of second box
+   */
+  void addContact(const int a, const int b);
+
+  /**
+   * Finds the touching pairs and compares them to the last step
+   *
+   * @return Pairs that began, persisted or ended, valid until the next step
+   */
+  const std::vector<Event>& step();
+};
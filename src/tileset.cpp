@@ -1,5 +1,7 @@
 #include "tileset.h"
 
+#include "engine.h"
+#include "resources.h"
 #include "util.h"
 
 #include <iostream>
@@ -7,33 +9,31 @@
 
 namespace map {
 
-Tileset::Tileset(const std::string& basePath,
-                 const nlohmann::json& tilesetData) {
-  load(basePath, tilesetData);
-
-  defaultTile_.walkable = false;
-  defaultTile_.frame = 0;
-}
-
-bool Tileset::load(const std::string& basePath,
-                   const nlohmann::json& tilesetData) {
-  auto texturePath = tilesetData["image"].get<std::string>();
-  tileWidth_ = tilesetData["tilewidth"].get<int>();
-  tileHeight_ = tilesetData["tileheight"].get<int>();
-
-  tileCount_ = tilesetData["tilecount"].get<int>();
-  firstGid_ = tilesetData["firstgid"].get<int>();
-  columns_ = tilesetData["columns"].get<int>();
-
-  name_ = tilesetData["name"].get<std::string>();
-
-  texture_.loadFromFile(basePath + "/" + texturePath);
-  tile_.setTexture(texture_);
+TilesetDefinition readTilesetDefinition(const nlohmann::json& tilesetData) {
+  TilesetDefinition definition;
+  definition.image = tilesetData["image"].get<std::string>();
+  definition.tileWidth = tilesetData["tilewidth"].get<int>();
+  definition.tileHeight = tilesetData["tileheight"].get<int>();
+
+  definition.tileCount = tilesetData["tilecount"].get<int>();
+  definition.firstGid = tilesetData["firstgid"].get<int>();
+  definition.columns = tilesetData["columns"].get<int>();
+
+  definition.name = tilesetData["name"].get<std::string>();
+
+  // Tiles without properties aren't walkable
+  auto& tiles = definition.tiles;
+  tiles.resize(definition.tileCount);
+  for (int i = 0; i < definition.tileCount; i++) {
+    tiles[i].walkable = false;
+    tiles[i].frame = 0;
+    tiles[i].animationTiles.push_back(i);
+  }
 
   auto properties = tilesetData.find("tileproperties");
   auto animationData = tilesetData.find("tiles");
   if (properties != tilesetData.end()) {
-    for (int i = 0; i < tileCount_; i++) {
+    for (int i = 0; i < definition.tileCount; i++) {
       TileProperties t;
       auto res = (*properties).find(std::to_string(i));
       if (res == (*properties).end()) {
@@ -64,10 +64,43 @@ bool Tileset::load(const std::string& basePath,
         t.animationTiles.push_back(i);
       }
 
-      tiles_[i] = t;
+      tiles[i] = t;
     }
   }
 
+  return definition;
+}
+
+Tileset::Tileset(const std::string& basePath,
+                 const nlohmann::json& tilesetData)
+    : Tileset(basePath, readTilesetDefinition(tilesetData)) {}
+
+Tileset::Tileset(const std::string& basePath,
+                 const TilesetDefinition& definition) {
+  load(basePath, definition);
+
+  defaultTile_.walkable = false;
+  defaultTile_.frame = 0;
+}
+
+bool Tileset::load(const std::string& basePath,
+                   const TilesetDefinition& definition) {
+  tileWidth_ = definition.tileWidth;
+  tileHeight_ = definition.tileHeight;
+
+  tileCount_ = definition.tileCount;
+  firstGid_ = definition.firstGid;
+  columns_ = definition.columns;
+
+  name_ = definition.name;
+
+  if (!Engine::headless()) {
+    texture_ = resources::texture(basePath + "/" + definition.image);
+    tile_.setTexture(*texture_);
+  }
+
+  tiles_ = definition.tiles;
+
   lastTicks_ = 0;
 
   return true;
@@ -83,34 +116,29 @@ bool Tileset::contains(TileId tile) {
   return tile >= firstGid_ && tile < firstGid_ + tileCount_;
 }
 
-bool Tileset::walkable(TileId tile) {
-  tile = removeFlags(tile);
-  return tiles_[tile - firstGid_].walkable;
+bool Tileset::walkable(TileId t) {
+  t = removeFlags(t);
+  return tile(t - firstGid_).walkable;
 }
 
 bool Tileset::update(const sf::Time& time) {
   time_ += time;
   if (time_ >= sf::milliseconds(500)) {
     for (auto& tile : tiles_) {
-      tile.second.frame =
-          (tile.second.frame + 1) % tile.second.animationTiles.size();
+      tile.frame = (tile.frame + 1) % tile.animationTiles.size();
     }
+    ++animationFrame_;
     time_ = sf::seconds(0);
   }
   return true;
 }
 
-void Tileset::renderTile(sf::RenderTarget& window, TileId tile, float x,
-                         float y) {
-  if (tile == 0) {
-    return;
-  }
-
+void Tileset::tileSource(TileId tile, sf::IntRect& source, float& angle) {
   bool flipHorizontal = (tile & FLIPPED_HORIZONTALLY) != 0;
   bool flipVertical = (tile & FLIPPED_VERTICALLY) != 0;
   bool flipDiagonal = (tile & FLIPPED_DIAGONALLY) != 0;
 
-  float angle = 0.f;
+  angle = 0.f;
   if (flipDiagonal) {
     angle = 90.f;
     flipVertical = !(tile & FLIPPED_HORIZONTALLY);
@@ -122,8 +150,9 @@ void Tileset::renderTile(sf::RenderTarget& window, TileId tile, float x,
   tile -= firstGid_;
   tile = tileFor(tile);
 
-  sf::IntRect source(tileWidth_ * (tile % columns_),
-                     tileHeight_ * (tile / columns_), tileWidth_, tileHeight_);
+  source = sf::IntRect(tileWidth_ * (tile % columns_),
+                       tileHeight_ * (tile / columns_), tileWidth_,
+                       tileHeight_);
 
   if (flipHorizontal) {
     source.left += tileWidth_;
@@ -133,6 +162,17 @@ void Tileset::renderTile(sf::RenderTarget& window, TileId tile, float x,
     source.top += tileHeight_;
     source.height = -tileHeight_;
   }
+}
+
+void Tileset::renderTile(sf::RenderTarget& window, TileId tile, float x,
+                         float y) {
+  if (tile == 0) {
+    return;
+  }
+
+  sf::IntRect source;
+  float angle;
+  tileSource(tile, source, angle);
 
   tile_.setTextureRect(source);
   tile_.setRotation(angle);
@@ -141,4 +181,20 @@ void Tileset::renderTile(sf::RenderTarget& window, TileId tile, float x,
   window.draw(tile_);
 }
 
+void Tileset::appendTile(std::vector<sf::Vertex>& vertices, TileId tile,
+                         float x, float y) {
+  if (tile == 0) {
+    return;
+  }
+
+  sf::IntRect source;
+  float angle;
+  tileSource(tile, source, angle);
+
+  sf::Transform transform;
+  transform.translate(x, y).rotate(angle);
+
+  appendQuad(vertices, transform, source);
+}
+
 }  // namespace map
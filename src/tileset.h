@@ -1,20 +1,25 @@
 #pragma once
 
+#include "render_snapshot.h"
 #include "util.h"
 
 #include <json.hpp>
 
 #include <SFML/Graphics.hpp>
 
+#include <memory>
 #include <stdexcept>
 #include <string>
-#include <unordered_map>
 #include <vector>
 
 namespace map {
 
 typedef unsigned int TileId;
 
+// Tiled stores flip flags in the top 3 bits of global tile IDs
+const TileId TILE_FLAGS_MASK = 0xE0000000;
+const TileId TILE_FLIPPED_DIAGONALLY = 0x20000000;
+
 /**
  * Container for all the various tile properties
  */
@@ -25,6 +30,34 @@ struct TileProperties {
   int frame;
 };
 
+/**
+ * Everything a tileset is loaded from, independent of the file format it
+ * was read from
+ */
+struct TilesetDefinition {
+  std::string name;
+
+  // Path of the tileset image relative to the map
+  std::string image;
+
+  int tileWidth = 0;
+  int tileHeight = 0;
+  int tileCount = 0;
+  int columns = 0;
+  TileId firstGid = 0;
+
+  // Tile properties indexed by tile ID within the tileset
+  std::vector<TileProperties> tiles;
+};
+
+/**
+ * Reads a tileset definition from a Tiled tileset JSON object
+ *
+ * @param tilesetData JSON object to read
+ * @return Tileset definition
+ */
+TilesetDefinition readTilesetDefinition(const nlohmann::json& tilesetData);
+
 /**
  * Class to load, query, and render tiles in a tileset
  */
@@ -40,6 +73,8 @@ class Tileset {
 
   sf::Time time_;
 
+  unsigned int animationFrame_ = 0;
+
   // Updated and returned when a tile is not found
   TileProperties defaultTile_;
 
@@ -55,21 +90,22 @@ class Tileset {
 
   std::string name_;
 
-  // Map of tile ID to tile properties
-  std::unordered_map<TileId, TileProperties> tiles_;
+  // Tile properties indexed by tile ID within the tileset
+  std::vector<TileProperties> tiles_;
 
-  sf::Texture texture_;
+  // Not loaded when running headless. Shared with render snapshots.
+  std::shared_ptr<const sf::Texture> texture_;
   sf::Sprite tile_;
 
   /**
-   * Loads a tileset from the passed JSON object
+   * Loads a tileset from the passed definition
    *
-   * @param basePath Path the JSON was loaded from. Used to resolve relative
+   * @param basePath Path the map was loaded from. Used to resolve relative
    * paths.
-   * @param tilesetData JSON object to load tileset from
+   * @param definition Definition to load tileset from
    * @return Whether the operation was successful
    */
-  bool load(const std::string& basePath, const nlohmann::json& tilesetData);
+  bool load(const std::string& basePath, const TilesetDefinition& definition);
 
   /**
    * Removes rotation and reflection flags on a tile
@@ -79,9 +115,21 @@ class Tileset {
    */
   TileId removeFlags(TileId tile);
 
+  /**
+   * Resolves the texture rectangle and rotation to draw a tile with,
+   * applying its flags and current animation frame
+   *
+   * @param tile Tile index, including flags
+   * @param source Set to the texture rectangle, negative sizes flip the tile
+   * @param angle Set to the rotation in degrees
+   */
+  void tileSource(TileId tile, sf::IntRect& source, float& angle);
+
  public:
   Tileset(const std::string& basePath, const nlohmann::json& tilesetData);
 
+  Tileset(const std::string& basePath, const TilesetDefinition& definition);
+
   /**
    * Gets TileProperties for the given tile index or the default tile if
    * the tile is not found
@@ -90,11 +138,10 @@ class Tileset {
    * @return Found TileProperties
    */
   const TileProperties& tile(const TileId t) {
-    auto res = tiles_.find(t);
-    if (res == tiles_.end()) {
+    if (t >= tiles_.size()) {
       return defaultTile_;
     }
-    return res->second;
+    return tiles_[t];
   }
 
   /**
@@ -104,7 +151,7 @@ class Tileset {
    * @return Current tile index for animation
    */
   TileId tileFor(const TileId tileIdx) {
-    auto t = tile(tileIdx);
+    const auto& t = tile(tileIdx);
     if (t.animationTiles.empty()) {
       return tileIdx;
     }
@@ -125,6 +172,35 @@ class Tileset {
    */
   int height() { return tileHeight_; }
 
+  /**
+   * Gets the tileset texture, or nullptr when running headless
+   *
+   * @return Tileset texture
+   */
+  const std::shared_ptr<const sf::Texture>& texture() { return texture_; }
+
+  /**
+   * Gets a counter that increases every time the tileset's animations
+   * advance a frame
+   *
+   * @return Animation frame counter
+   */
+  unsigned int animationFrame() { return animationFrame_; }
+
+  /**
+   * Gets the global ID of the tileset's first tile
+   *
+   * @return First global tile ID
+   */
+  TileId firstGid() { return firstGid_; }
+
+  /**
+   * Gets the number of tiles in the tileset
+   *
+   * @return Number of tiles
+   */
+  int tileCount() { return tileCount_; }
+
   /**
    * Checks if the tileset contains the given tile
    *
@@ -158,6 +234,19 @@ class Tileset {
    * @param y Y coordinate of render point
    */
   void renderTile(sf::RenderTarget& window, TileId tile, float x, float y);
+
+  /**
+   * Appends a quad drawing the given tile at the specified point, with its
+   * flips, rotation and current animation frame baked into the texture
+   * coordinates
+   *
+   * @param vertices Vertex list to append to
+   * @param tile Tile index to add
+   * @param x X coordinate of render point
+   * @param y Y coordinate of render point
+   */
+  void appendTile(std::vector<sf::Vertex>& vertices, TileId tile, float x,
+                  float y);
 };
 
 }  // namespace map
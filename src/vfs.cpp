@@ -0,0 +1,349 @@
+#include "vfs.h"
+
+#include "log.h"
+#include "mapped_file.h"
+
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+namespace vfs {
+
+// Archive layout, in native (little endian) byte order:
+//
+//   header:  "PPAK", u16 version, u16 reserved, u32 entry count,
+//            u32 bucket count, u64 index offset, u64 strings offset
+//   index:   bucket count Entry slots, an open addressing hash table with
+//            linear probing. Empty slots have a hash of 0.
+//   strings: the path of every entry, to tell apart colliding hashes
+//   data:    the contents of every entry, each on an 8 byte boundary.
+//            Decoded images start with u32 width and u32 height.
+const char MAGIC[4] = {'P', 'P', 'A', 'K'};
+const std::uint16_t VERSION = 1;
+const std::size_t HEADER_SIZE = 32;
+const std::size_t DATA_ALIGNMENT = 8;
+
+enum class EntryKind : std::uint8_t {
+  RAW = 0,
+  RGBA = 1,
+};
+
+struct Entry {
+  std::uint64_t hash;
+  std::uint64_t offset;
+  std::uint64_t size;
+  std::uint32_t pathOffset;
+  std::uint16_t pathLength;
+  EntryKind kind;
+  std::uint8_t reserved;
+};
+static_assert(sizeof(Entry) == 32, "Index entries are 32 bytes in the file");
+
+MappedFile archive_;
+const char* index_ = nullptr;
+const char* strings_ = nullptr;
+std::uint32_t bucketCount_ = 0;
+
+std::string normalize(const std::string& path) {
+  std::vector<std::string> parts;
+  std::stringstream stream(path);
+  std::string part;
+  while (std::getline(stream, part, '/')) {
+    if (part.empty() || part == ".") {
+      continue;
+    }
+    if (part == ".." && !parts.empty() && parts.back() != "..") {
+      parts.pop_back();
+    } else {
+      parts.push_back(part);
+    }
+  }
+
+  std::string normalized;
+  for (const auto& p : parts) {
+    if (!normalized.empty()) {
+      normalized += "/";
+    }
+    normalized += p;
+  }
+  return normalized;
+}
+
+/**
+ * Hashes a normalized path with 64 bit FNV-1a, never returning 0
+ *
+ * @param path Path to hash
+ * @return Hash of path
+ */
+static std::uint64_t hashPath(const std::string& path) {
+  std::uint64_t hash = 14695981039346656037ull;
+  for (const char c : path) {
+    hash ^= (std::uint8_t)c;
+    hash *= 1099511628211ull;
+  }
+  return hash == 0 ? 1 : hash;
+}
+
+/**
+ * Finds the index entry for a path in the mounted archive
+ *
+ * @param path Path to find
+ * @param entry Set to the entry
+ * @return Whether the path was found
+ */
+static bool lookup(const std::string& path, Entry& entry) {
+  if (!index_) {
+    return false;
+  }
+
+  const auto normalized = normalize(path);
+  const auto hash = hashPath(normalized);
+  const std::size_t stringsSize =
+      (std::size_t)(archive_.data() + archive_.size() - strings_);
+  for (std::uint32_t i = 0; i < bucketCount_; i++) {
+    const std::uint32_t bucket =
+        (std::uint32_t)(hash + i) & (bucketCount_ - 1);
+    std::memcpy(&entry, index_ + (std::size_t)bucket * sizeof(Entry),
+                sizeof(Entry));
+    if (entry.hash == 0) {
+      return false;
+    }
+    if (entry.hash == hash && entry.pathLength == normalized.size() &&
+        entry.pathOffset <= stringsSize &&
+        stringsSize - entry.pathOffset >= entry.pathLength &&
+        std::memcmp(strings_ + entry.pathOffset, normalized.data(),
+                    normalized.size()) == 0) {
+      return entry.offset <= archive_.size() &&
+             archive_.size() - entry.offset >= entry.size;
+    }
+  }
+  return false;
+}
+
+bool mount(const std::string& path) {
+  unmount();
+
+  if (!archive_.open(path)) {
+    logger::error("Unable to open archive: " + path);
+    return false;
+  }
+
+  const char* data = archive_.data();
+  std::uint16_t version = 0;
+  std::uint64_t indexOffset = 0, stringsOffset = 0;
+  if (archive_.size() >= HEADER_SIZE) {
+    std::memcpy(&version, data + 4, sizeof(version));
+    std::memcpy(&bucketCount_, data + 12, sizeof(bucketCount_));
+    std::memcpy(&indexOffset, data + 16, sizeof(indexOffset));
+    std::memcpy(&stringsOffset, data + 24, sizeof(stringsOffset));
+  }
+
+  // Bucket counts are powers of two so probing can mask
+  const bool valid =
+      archive_.size() >= HEADER_SIZE &&
+      std::memcmp(data, MAGIC, sizeof(MAGIC)) == 0 && version == VERSION &&
+      bucketCount_ > 0 && (bucketCount_ & (bucketCount_ - 1)) == 0 &&
+      indexOffset + (std::uint64_t)bucketCount_ * sizeof(Entry) <=
+          stringsOffset &&
+      stringsOffset <= archive_.size();
+  if (!valid) {
+    logger::error("Not a valid archive: " + path);
+    unmount();
+    return false;
+  }
+
+  index_ = data + indexOffset;
+  strings_ = data + stringsOffset;
+  logger::info("Mounted archive " + path);
+  return true;
+}
+
+void unmount() {
+  archive_.close();
+  index_ = nullptr;
+  strings_ = nullptr;
+  bucketCount_ = 0;
+}
+
+bool mounted() { return index_ != nullptr; }
+
+bool find(const std::string& path, const char*& data, std::size_t& size) {
+  Entry entry;
+  if (!lookup(path, entry) || entry.kind != EntryKind::RAW) {
+    return false;
+  }
+  data = archive_.data() + entry.offset;
+  size = (std::size_t)entry.size;
+  return true;
+}
+
+bool readFile(const std::string& path, std::string& contents) {
+  const char* data;
+  std::size_t size;
+  if (find(path, data, size)) {
+    contents.assign(data, size);
+    return true;
+  }
+
+  std::ifstream file(path, std::ios::in | std::ios::binary);
+  if (!file.is_open()) {
+    return false;
+  }
+  std::stringstream fileData;
+  fileData << file.rdbuf();
+  contents = fileData.str();
+  return true;
+}
+
+bool loadTexture(sf::Texture& texture, const std::string& path) {
+  Entry entry;
+  if (lookup(path, entry)) {
+    const char* data = archive_.data() + entry.offset;
+    if (entry.kind == EntryKind::RAW) {
+      return texture.loadFromMemory(data, (std::size_t)entry.size);
+    }
+
+    std::uint32_t width = 0, height = 0;
+    if (entry.size >= 8) {
+      std::memcpy(&width, data, sizeof(width));
+      std::memcpy(&height, data + 4, sizeof(height));
+    }
+    if (entry.size < 8 || entry.size < 8 + (std::uint64_t)width * height * 4 ||
+        !texture.create(width, height)) {
+      logger::error("Bad decoded image in archive: " + path);
+      return false;
+    }
+    texture.update(reinterpret_cast<const sf::Uint8*>(data + 8));
+    return true;
+  }
+
+  return texture.loadFromFile(path);
+}
+
+/**
+ * Checks whether a path names an image SFML can decode
+ *
+ * @param path Path to check
+ * @return Whether the path has an image extension
+ */
+static bool isImage(const std::string& path) {
+  const auto dot = path.find_last_of(".");
+  if (dot == std::string::npos) {
+    return false;
+  }
+  auto extension = path.substr(dot + 1);
+  for (auto& c : extension) {
+    c = (char)std::tolower(c);
+  }
+  return extension == "png" || extension == "jpg" || extension == "jpeg" ||
+         extension == "bmp" || extension == "tga";
+}
+
+template <typename T>
+static void append(std::string& out, const T& value) {
+  out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+static void pad(std::string& out) {
+  out.resize((out.size() + DATA_ALIGNMENT - 1) / DATA_ALIGNMENT *
+             DATA_ALIGNMENT);
+}
+
+bool pack(const std::vector<std::string>& paths, const std::string& out,
+          const bool decodeImages) {
+  // At most half full so probe sequences stay short
+  std::uint32_t bucketCount = 1;
+  while (bucketCount < paths.size() * 2) {
+    bucketCount *= 2;
+  }
+
+  std::vector<Entry> index(bucketCount);
+  std::memset(index.data(), 0, index.size() * sizeof(Entry));
+  std::string strings;
+  std::string data;
+
+  for (const auto& path : paths) {
+    const auto normalized = normalize(path);
+    Entry entry;
+    std::memset(&entry, 0, sizeof(entry));
+    entry.hash = hashPath(normalized);
+    entry.pathOffset = (std::uint32_t)strings.size();
+    entry.pathLength = (std::uint16_t)normalized.size();
+    strings.append(normalized);
+
+    pad(data);
+    entry.offset = data.size();
+
+    sf::Image image;
+    if (decodeImages && isImage(path) && image.loadFromFile(path)) {
+      const auto size = image.getSize();
+      append(data, (std::uint32_t)size.x);
+      append(data, (std::uint32_t)size.y);
+      data.append(reinterpret_cast<const char*>(image.getPixelsPtr()),
+                  (std::size_t)size.x * size.y * 4);
+      entry.kind = EntryKind::RGBA;
+    } else {
+      std::string contents;
+      std::ifstream file(path, std::ios::in | std::ios::binary);
+      if (!file.is_open()) {
+        logger::error("Unable to open file to pack: " + path);
+        return false;
+      }
+      std::stringstream fileData;
+      fileData << file.rdbuf();
+      data.append(fileData.str());
+      entry.kind = EntryKind::RAW;
+    }
+    entry.size = data.size() - entry.offset;
+
+    std::uint32_t bucket = (std::uint32_t)entry.hash & (bucketCount - 1);
+    while (index[bucket].hash != 0) {
+      if (index[bucket].hash == entry.hash &&
+          strings.compare(index[bucket].pathOffset, index[bucket].pathLength,
+                          normalized) == 0) {
+        logger::error("Packed twice: " + path);
+        return false;
+      }
+      bucket = (bucket + 1) & (bucketCount - 1);
+    }
+    index[bucket] = entry;
+  }
+
+  const std::uint64_t indexOffset = HEADER_SIZE;
+  const std::uint64_t stringsOffset =
+      indexOffset + (std::uint64_t)bucketCount * sizeof(Entry);
+  std::uint64_t dataOffset = stringsOffset + strings.size();
+  dataOffset = (dataOffset + DATA_ALIGNMENT - 1) / DATA_ALIGNMENT *
+               DATA_ALIGNMENT;
+  for (auto& entry : index) {
+    if (entry.hash != 0) {
+      entry.offset += dataOffset;
+    }
+  }
+
+  std::string archive;
+  archive.append(MAGIC, sizeof(MAGIC));
+  append(archive, VERSION);
+  append(archive, (std::uint16_t)0);
+  append(archive, (std::uint32_t)paths.size());
+  append(archive, bucketCount);
+  append(archive, indexOffset);
+  append(archive, stringsOffset);
+  archive.append(reinterpret_cast<const char*>(index.data()),
+                 index.size() * sizeof(Entry));
+  archive.append(strings);
+  pad(archive);
+
+  std::ofstream file(out, std::ios::binary | std::ios::trunc);
+  if (!file.is_open()) {
+    logger::error("Unable to write archive: " + out);
+    return false;
+  }
+  file.write(archive.data(), archive.size());
+  file.write(data.data(), data.size());
+  return (bool)file;
+}
+
+}  // namespace vfs
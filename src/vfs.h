@@ -0,0 +1,86 @@
+#pragma once
+
+#include <SFML/Graphics.hpp>
+
+#include <string>
+#include <vector>
+
+/**
+ * Serves assets out of a memory-mapped archive, falling back to loose
+ * files for anything the archive doesn't hold or when none is mounted.
+ * Paths are looked up as given to the loaders, relative to the working
+ * directory, after resolving "." and "..".
+ */
+namespace vfs {
+
+/**
+ * Resolves "." and ".." in a path and drops repeated separators
+ *
+ * @param path Path to normalize
+ * @return Normalized path
+ */
+std::string normalize(const std::string& path);
+
+/**
+ * Maps an archive written by pack, replacing any mounted archive
+ *
+ * @param path Path of archive
+ * @return Whether the operation was successful
+ */
+bool mount(const std::string& path);
+
+/**
+ * Unmounts the archive. Data handed out by find is invalid afterwards, as
+ * are fonts loaded from the archive.
+ */
+void unmount();
+
+/**
+ * Gets whether an archive is mounted
+ *
+ * @return Whether an archive is mounted
+ */
+bool mounted();
+
+/**
+ * Finds a file stored as is in the mounted archive
+ *
+ * @param path Path of file
+ * @param data Set to the file's contents, valid until unmount
+ * @param size Set to the file's size
+ * @return Whether the file was found
+ */
+bool find(const std::string& path, const char*& data, std::size_t& size);
+
+/**
+ * Reads a whole file from the archive or disk
+ *
+ * @param path Path of file
+ * @param contents Set to the file's contents
+ * @return Whether the file was read
+ */
+bool readFile(const std::string& path, std::string& contents);
+
+/**
+ * Loads a texture from the archive, using its pre-decoded pixels if the
+ * archive has them, or from disk
+ *
+ * @param texture Texture to load into
+ * @param path Path of image
+ * @return Whether the texture was loaded
+ */
+bool loadTexture(sf::Texture& texture, const std::string& path);
+
+/**
+ * Writes an archive holding the given files under the paths given
+ *
+ * @param paths Files to pack
+ * @param out Path to write archive to
+ * @param decodeImages Whether to store images as decoded RGBA pixels,
+ * which are bigger but skip decoding at load
+ * @return Whether the operation was successful
+ */
+bool pack(const std::vector<std::string>& paths, const std::string& out,
+          const bool decodeImages);
+
+}  // namespace vfs
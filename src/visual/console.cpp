@@ -2,6 +2,7 @@
 
 #include "../constants.h"
 #include "../log.h"
+#include "../resources.h"
 
 #include <deque>
 
@@ -23,7 +24,7 @@ std::deque<sf::Text> outputs_;
 
 sf::FloatRect dimensions_;
 
-sf::Font font_;
+std::shared_ptr<const sf::Font> font_;
 
 sf::Text prompt_;
 sf::Text command_;
@@ -81,16 +82,16 @@ std::string runCommand(std::string command) {
 }
 
 void initialize() {
-  font_.loadFromFile("assets/fonts/Anonymous.ttf");
+  font_ = resources::font("assets/fonts/Anonymous.ttf");
 
-  prompt_.setFont(font_);
+  prompt_.setFont(*font_);
   prompt_.setCharacterSize(FONT_SIZE);
   prompt_.setPosition(MARGIN, MARGIN);
   prompt_.setString(">");
   prompt_.setFillColor(sf::Color::White);
 
   const auto size = prompt_.getGlobalBounds();
-  command_.setFont(font_);
+  command_.setFont(*font_);
   command_.setCharacterSize(FONT_SIZE);
   command_.setPosition(MARGIN + 2 * size.width, MARGIN);
   command_.setFillColor(sf::Color::White);
@@ -110,7 +111,7 @@ void handleEvent(sf::Event& event) {
     }
   } else if (event.type == sf::Event::KeyPressed) {
     if (event.key.code == sf::Keyboard::C) {
-      if (sf::Keyboard::isKeyPressed(sf::Keyboard::LControl)) {
+      if (event.key.control) {
         hide();
       }
     } else if (event.key.code == sf::Keyboard::BackSpace) {
@@ -129,7 +130,7 @@ void handleEvent(sf::Event& event) {
       auto output = runCommand(str);
 
       sf::Text line;
-      line.setFont(font_);
+      line.setFont(*font_);
       line.setCharacterSize(FONT_SIZE);
       line.setFillColor(sf::Color::White);
       line.setString(output);
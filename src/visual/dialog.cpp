@@ -1,12 +1,15 @@
 #include "dialog.h"
 
+#include "../resources.h"
+
 #include <algorithm>
 
 namespace visual {
 
 Dialog::Dialog(const std::string& message)
-    : message_(message), lines_(buildLines(message_)) {
-  font_.loadFromFile("assets/fonts/arcade.ttf");
+    : message_(message),
+      font_(resources::font("assets/fonts/arcade.ttf")),
+      lines_(buildLines(message_)) {
   map_ = std::make_unique<map::Map>("assets/maps/dialog.json");
   map_->setPosition(position_.x, position_.y);
 
@@ -44,7 +47,7 @@ std::deque<sf::Text> Dialog::buildLines(const std::string& message) {
       tmp = "";
     }
     sf::Text text;
-    text.setFont(font_);
+    text.setFont(*font_);
     text.setString(line);
 
     text.setFillColor(sf::Color::White);
@@ -82,7 +85,7 @@ void Dialog::reflowText() {
   } else {
     if (!moreIndicator_) {
       moreIndicator_ = std::make_unique<sf::Text>();
-      moreIndicator_->setFont(font_);
+      moreIndicator_->setFont(*font_);
     }
     auto dim = moreIndicator_->getGlobalBounds();
     moreIndicator_->setPosition(
@@ -103,13 +106,13 @@ void Dialog::reflowText() {
 
   if (!choiceIndicator_) {
     choiceIndicator_ = std::make_unique<sf::Text>();
-    choiceIndicator_->setFont(font_);
+    choiceIndicator_->setFont(*font_);
   }
   float offset = 0;
   float padding = 10;
   for (std::size_t i = 0; i < choices_.size(); i++) {
     sf::Text choiceText;
-    choiceText.setFont(font_);
+    choiceText.setFont(*font_);
     choiceText.setString(choices_[i]);
     choiceText.setFillColor(sf::Color::White);
     const auto dim = choiceText.getGlobalBounds();
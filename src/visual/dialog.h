@@ -42,7 +42,8 @@ class Dialog {
   // Choices in dialog
   std::vector<std::string> choices_;
 
-  sf::Font font_;
+  // Must be declared before lines_, which is built from it
+  std::shared_ptr<const sf::Font> font_;
 
   // Vector of renderable lines of text
   std::deque<sf::Text> lines_;
@@ -0,0 +1,80 @@
+#include "profiler_overlay.h"
+
+#include "../constants.h"
+#include "../resources.h"
+
+#include <iomanip>
+#include <sstream>
+
+namespace visual {
+
+namespace ProfilerOverlay {
+
+bool visible_ = false;
+
+int framesUntilRefresh_ = 0;
+
+std::shared_ptr<const sf::Font> font_;
+
+sf::Text text_;
+
+static std::string formatStats() {
+  std::stringstream out;
+  out << std::fixed << std::setprecision(2);
+  out << std::left << std::setw(14) << "phase (ms)" << std::right
+      << std::setw(7) << "min" << std::setw(7) << "avg" << std::setw(7)
+      << "p99" << "\n";
+  for (int i = 0; i < static_cast<int>(profiler::Phase::COUNT); i++) {
+    const auto phase = static_cast<profiler::Phase>(i);
+    const auto stats = profiler::stats(phase);
+    out << std::left << std::setw(14) << profiler::phaseName(phase)
+        << std::right << std::setw(7) << stats.min.asSeconds() * 1000
+        << std::setw(7) << stats.avg.asSeconds() * 1000 << std::setw(7)
+        << stats.p99.asSeconds() * 1000 << "\n";
+  }
+  out << profiler::frames() << " frames\n";
+
+  const auto textures = resources::textureUsage();
+  const auto fonts = resources::fontUsage();
+  out << textures.count << " textures " << textures.bytes / 1024 << " KB\n";
+  out << fonts.count << " fonts " << fonts.bytes / 1024 << " KB";
+  return out.str();
+}
+
+void initialize() {
+  font_ = resources::font("assets/fonts/Anonymous.ttf");
+
+  text_.setFont(*font_);
+  text_.setCharacterSize(FONT_SIZE);
+  text_.setFillColor(sf::Color::White);
+}
+
+void toggle() {
+  visible_ = !visible_;
+  framesUntilRefresh_ = 0;
+}
+
+bool visible() { return visible_; }
+
+void render(sf::RenderTarget& window) {
+  if (--framesUntilRefresh_ <= 0) {
+    text_.setString(formatStats());
+    framesUntilRefresh_ = REFRESH_FRAMES;
+  }
+
+  const auto size = text_.getLocalBounds();
+  text_.setPosition(SCREEN_WIDTH - size.width - 2 * MARGIN, MARGIN);
+
+  sf::RectangleShape background;
+  background.setPosition(SCREEN_WIDTH - size.width - 3 * MARGIN, 0);
+  background.setSize(
+      sf::Vector2f(size.width + 3 * MARGIN, size.height + 3 * MARGIN));
+  background.setFillColor(sf::Color(42, 42, 42, 200));
+  window.draw(background);
+
+  window.draw(text_);
+}
+
+}  // namespace ProfilerOverlay
+
+}  // namespace visual
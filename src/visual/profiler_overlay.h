@@ -0,0 +1,43 @@
+#pragma once
+
+#include "../profiler.h"
+
+#include <SFML/Graphics.hpp>
+
+namespace visual {
+
+namespace ProfilerOverlay {
+
+const float MARGIN = 2;
+const int FONT_SIZE = 8;
+
+// Number of frames between recomputing the displayed stats
+const int REFRESH_FRAMES = 30;
+
+/**
+ * Initializes all overlay assets
+ */
+void initialize();
+
+/**
+ * Shows the overlay if hidden and hides it if shown
+ */
+void toggle();
+
+/**
+ * Gets whether or not overlay is visible
+ *
+ * @return Whether or not overlay is visible
+ */
+bool visible();
+
+/**
+ * Renders min/avg/p99 of each profiler phase
+ *
+ * @param window Window to render to
+ */
+void render(sf::RenderTarget& window);
+
+}  // namespace ProfilerOverlay
+
+}  // namespace visual
@@ -0,0 +1,452 @@
+#include "world.h"
+
+#include "constants.h"
+#include "log.h"
+#include "util.h"
+#include "vfs.h"
+
+#include <json.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace map {
+
+const std::string WORLD_EXTENSION = ".world";
+
+bool isWorldPath(const std::string& path) {
+  return path.size() >= WORLD_EXTENSION.size() &&
+         path.compare(path.size() - WORLD_EXTENSION.size(),
+                      WORLD_EXTENSION.size(), WORLD_EXTENSION) == 0;
+}
+
+World::World(const std::string& path, const std::size_t memoryBudget)
+    : memoryBudget_(memoryBudget) {
+  path_ = path;
+  if (loadWorld(path)) {
+    loader_ = std::thread(&World::loaderLoop, this);
+  }
+}
+
+World::~World() {
+  {
+    std::lock_guard<std::mutex> lock(loadMutex_);
+    stopping_ = true;
+  }
+  loadWake_.notify_all();
+  if (loader_.joinable()) {
+    loader_.join();
+  }
+}
+
+bool World::loadWorld(const std::string& path) {
+  std::string fileData;
+  if (!vfs::readFile(path, fileData)) {
+    logger::warning("Unable to open world file: " + path);
+    return false;
+  }
+
+  const auto worldBasePath = path.substr(0, path.find_last_of("/"));
+  const auto worldData = nlohmann::json::parse(fileData);
+
+  for (const auto& mapData : worldData["maps"]) {
+    Room room;
+    room.path = worldBasePath + "/" + mapData["fileName"].get<std::string>();
+    room.bounds = sf::FloatRect(
+        mapData["x"].get<float>(), mapData["y"].get<float>(),
+        mapData["width"].get<float>(), mapData["height"].get<float>());
+    rooms_.push_back(std::move(room));
+  }
+  if (rooms_.empty()) {
+    logger::warning(path + " has no maps");
+    return false;
+  }
+
+  // Tiled allows rooms left of or above the origin, but map coordinates
+  // start at zero
+  float left = std::numeric_limits<float>::max();
+  float top = std::numeric_limits<float>::max();
+  float right = std::numeric_limits<float>::lowest();
+  float bottom = std::numeric_limits<float>::lowest();
+  for (const auto& room : rooms_) {
+    left = std::min(left, room.bounds.left);
+    top = std::min(top, room.bounds.top);
+    right = std::max(right, room.bounds.left + room.bounds.width);
+    bottom = std::max(bottom, room.bounds.top + room.bounds.height);
+  }
+  for (auto& room : rooms_) {
+    room.bounds.left -= left;
+    room.bounds.top -= top;
+  }
+
+  // The world file doesn't say how big tiles are, so the first room is
+  // loaded up front to find out. Every room must use the same tile size.
+  placeRoom(0, std::make_unique<Map>(rooms_[0].path));
+  if (!rooms_[0].map) {
+    return false;
+  }
+  tileWidth_ = rooms_[0].map->tileWidth();
+  tileHeight_ = rooms_[0].map->tileHeight();
+
+  mapWidth_ = (int)std::ceil((right - left) / tileWidth_);
+  mapHeight_ = (int)std::ceil((bottom - top) / tileHeight_);
+  mapPixelWidth_ = mapWidth_ * tileWidth_;
+  mapPixelHeight_ = mapHeight_ * tileHeight_;
+
+  for (const auto& room : rooms_) {
+    if ((int)room.bounds.left % tileWidth_ != 0 ||
+        (int)room.bounds.top % tileHeight_ != 0) {
+      logger::warning(room.path + " isn't aligned to the tile grid");
+    }
+  }
+
+  gridWide_ = (mapPixelWidth_ + ROOM_GRID_PIXELS - 1) / ROOM_GRID_PIXELS;
+  gridHigh_ = (mapPixelHeight_ + ROOM_GRID_PIXELS - 1) / ROOM_GRID_PIXELS;
+  roomGrid_.resize((std::size_t)gridWide_ * gridHigh_);
+  for (std::size_t i = 0; i < rooms_.size(); i++) {
+    const auto& bounds = rooms_[i].bounds;
+    const int xStart = (int)bounds.left / ROOM_GRID_PIXELS;
+    const int xEnd = (int)(bounds.left + bounds.width - 1) / ROOM_GRID_PIXELS;
+    const int yStart = (int)bounds.top / ROOM_GRID_PIXELS;
+    const int yEnd = (int)(bounds.top + bounds.height - 1) / ROOM_GRID_PIXELS;
+    for (int y = yStart; y <= yEnd && y < gridHigh_; y++) {
+      for (int x = xStart; x <= xEnd && x < gridWide_; x++) {
+        roomGrid_[(std::size_t)y * gridWide_ + x].push_back(i);
+      }
+    }
+  }
+
+  return true;
+}
+
+void World::loaderLoop() {
+  std::unique_lock<std::mutex> lock(loadMutex_);
+  while (true) {
+    loadWake_.wait(lock, [this]() { return stopping_ || !loadQueue_.empty(); });
+    if (stopping_) {
+      return;
+    }
+
+    inFlight_ = loadQueue_.front();
+    loadQueue_.pop_front();
+    const auto path = rooms_[inFlight_].path;
+
+    lock.unlock();
+    auto room = std::make_unique<Map>(path);
+    lock.lock();
+
+    loaded_.emplace_back(inFlight_, std::move(room));
+    inFlight_ = NO_ROOM;
+  }
+}
+
+void World::placeRoom(const std::size_t index, std::unique_ptr<Map> room) {
+  auto& slot = rooms_[index];
+  if (slot.map) {
+    // Loaded synchronously while the loader was on it too
+    return;
+  }
+
+  // Map leaves its dimensions at zero when the file can't be read
+  if (room->pixelWidth() == 0) {
+    logger::warning("Unable to load room " + slot.path);
+    slot.failed = true;
+    return;
+  }
+
+  room->setPosition(slot.bounds.left, slot.bounds.top);
+  slot.map = std::move(room);
+  slot.lastUsed = streamCount_;
+}
+
+void World::collectLoaded() {
+  std::vector<std::pair<std::size_t, std::unique_ptr<Map>>> loaded;
+  {
+    std::lock_guard<std::mutex> lock(loadMutex_);
+    loaded.swap(loaded_);
+  }
+  for (auto& room : loaded) {
+    placeRoom(room.first, std::move(room.second));
+  }
+}
+
+void World::roomsIn(const sf::FloatRect rect,
+                    const std::function<void(std::size_t)>& func) {
+  int xStart = (int)std::floor(rect.left / ROOM_GRID_PIXELS);
+  int xEnd = (int)std::floor((rect.left + rect.width) / ROOM_GRID_PIXELS);
+  int yStart = (int)std::floor(rect.top / ROOM_GRID_PIXELS);
+  int yEnd = (int)std::floor((rect.top + rect.height) / ROOM_GRID_PIXELS);
+  util::clamp<int>(xStart, 0, gridWide_ - 1);
+  util::clamp<int>(xEnd, 0, gridWide_ - 1);
+  util::clamp<int>(yStart, 0, gridHigh_ - 1);
+  util::clamp<int>(yEnd, 0, gridHigh_ - 1);
+
+  // Rooms spanning several grid cells are only visited from the first cell
+  // of the rectangle they appear in
+  for (int y = yStart; y <= yEnd; y++) {
+    for (int x = xStart; x <= xEnd; x++) {
+      for (const auto index : roomGrid_[(std::size_t)y * gridWide_ + x]) {
+        const auto& bounds = rooms_[index].bounds;
+        const int firstX =
+            std::max(xStart, (int)bounds.left / ROOM_GRID_PIXELS);
+        const int firstY =
+            std::max(yStart, (int)bounds.top / ROOM_GRID_PIXELS);
+        if (x == firstX && y == firstY && bounds.intersects(rect)) {
+          func(index);
+        }
+      }
+    }
+  }
+}
+
+World::Room* World::roomAt(const float x, const float y) {
+  if (x < 0 || y < 0 || x >= mapPixelWidth_ || y >= mapPixelHeight_) {
+    return nullptr;
+  }
+  const auto& cell = roomGrid_[(std::size_t)((int)y / ROOM_GRID_PIXELS) *
+                                   gridWide_ +
+                               (int)x / ROOM_GRID_PIXELS];
+  for (const auto index : cell) {
+    if (rooms_[index].bounds.contains(x, y)) {
+      return &rooms_[index];
+    }
+  }
+  return nullptr;
+}
+
+std::set<TileId> World::hitTiles(const float x, const float y, const float w,
+                                 const float h) {
+  const sf::FloatRect rect(x, y, w, h);
+  std::set<TileId> tiles;
+  roomsIn(rect, [this, &rect, &tiles](std::size_t index) {
+    auto& room = rooms_[index];
+    sf::FloatRect overlap;
+    if (!room.map || !room.bounds.intersects(rect, overlap)) {
+      return;
+    }
+    const auto roomTiles = room.map->hitTiles(toRoom(room, overlap));
+    tiles.insert(roomTiles.begin(), roomTiles.end());
+  });
+  return tiles;
+}
+
+bool World::setTile(const int layer, const int x, const int y,
+                    const TileId tile) {
+  auto room = roomAt((float)x * tileWidth_, (float)y * tileHeight_);
+  if (!room || !room->map) {
+    logger::warning("Tile not in a loaded room: " + std::to_string(x) + ", " +
+                    std::to_string(y));
+    return false;
+  }
+
+  const int roomX = x - (int)room->bounds.left / tileWidth_;
+  const int roomY = y - (int)room->bounds.top / tileHeight_;
+  if (!room->map->setTile(layer, roomX, roomY, tile)) {
+    return false;
+  }
+  room->modified = true;
+  return true;
+}
+
+float World::ceilingAt(const sf::FloatRect dim, const float x) {
+  float top = dim.top;
+  auto room = roomAt(x, top);
+  while (room) {
+    if (!room->map) {
+      return dim.top;
+    }
+
+    const sf::FloatRect column(x, top, 1.f, dim.height);
+    const float found = room->map->positionOfTileAbove(toRoom(*room, column));
+    if (found > 0) {
+      return found + room->bounds.top;
+    }
+
+    // Nothing in this room, carry on from the bottom row of the one above
+    top = room->bounds.top - 1;
+    auto above = roomAt(x, top);
+    if (!above) {
+      return room->bounds.top;
+    }
+    room = above;
+  }
+  return dim.top;
+}
+
+float World::floorAt(const sf::FloatRect dim, const float x) {
+  float bottom = dim.top + dim.height - 1;
+  auto room = roomAt(x, bottom);
+  while (room) {
+    if (!room->map) {
+      return dim.top;
+    }
+
+    const sf::FloatRect column(x, bottom - dim.height + 1, 1.f, dim.height);
+    const float found = room->map->positionOfTileBelow(toRoom(*room, column));
+    if (found != std::numeric_limits<float>::max()) {
+      return found + room->bounds.top;
+    }
+
+    // Nothing in this room, carry on from the top row of the one below
+    bottom = room->bounds.top + room->bounds.height;
+    room = roomAt(x, bottom);
+  }
+  return std::numeric_limits<float>::max();
+}
+
+float World::positionOfTileAbove(const sf::FloatRect dim) {
+  return std::max(ceilingAt(dim, dim.left),
+                  ceilingAt(dim, dim.left + dim.width - 1));
+}
+
+float World::positionOfTileBelow(const sf::FloatRect dim) {
+  return std::min(floorAt(dim, dim.left),
+                  floorAt(dim, dim.left + dim.width - 1));
+}
+
+bool World::positionWalkable(const float x, const float y, const float w,
+                             const float h) {
+  // Default bounds detection
+  if (x < 0 || y < 0 || x + w > mapPixelWidth_ || y + h > mapPixelHeight_) {
+    return false;
+  }
+
+  // Gaps between rooms count as solid, so the rooms overlapping the
+  // rectangle have to cover all of it
+  const sf::FloatRect rect(x, y, w, h);
+  bool walkable = true;
+  float covered = 0;
+  roomsIn(rect, [this, &rect, &walkable, &covered](std::size_t index) {
+    auto& room = rooms_[index];
+    sf::FloatRect overlap;
+    if (!walkable || !room.bounds.intersects(rect, overlap)) {
+      return;
+    }
+    if (!room.map || !room.map->positionWalkable(toRoom(room, overlap))) {
+      walkable = false;
+      return;
+    }
+    covered += overlap.width * overlap.height;
+  });
+
+  return walkable && covered + 0.5f >= w * h;
+}
+
+std::size_t World::memoryUsage() {
+  std::size_t bytes = sizeof(*this) + rooms_.capacity() * sizeof(Room);
+  for (auto& room : rooms_) {
+    if (room.map) {
+      bytes += room.map->memoryUsage();
+    }
+  }
+  return bytes;
+}
+
+void World::stream(const sf::Vector2f cameraPos) {
+  if (rooms_.empty()) {
+    return;
+  }
+  ++streamCount_;
+  collectLoaded();
+
+  const sf::FloatRect view(cameraPos.x, cameraPos.y, (float)SCREEN_WIDTH,
+                           (float)SCREEN_HEIGHT);
+  const sf::FloatRect nearby(view.left - view.width, view.top - view.height,
+                             view.width * 3, view.height * 3);
+
+  std::vector<std::size_t> visible;
+  {
+    std::lock_guard<std::mutex> lock(loadMutex_);
+    loadQueue_.clear();
+    roomsIn(nearby, [this, &view, &visible](std::size_t index) {
+      auto& room = rooms_[index];
+      room.lastUsed = streamCount_;
+      if (room.map || room.failed || index == inFlight_) {
+        return;
+      }
+      if (room.bounds.intersects(view)) {
+        visible.push_back(index);
+      } else {
+        loadQueue_.push_back(index);
+      }
+    });
+  }
+  loadWake_.notify_one();
+
+  // Rooms on screen can't wait for the loader or they'd show up empty
+  for (const auto index : visible) {
+    placeRoom(index, std::make_unique<Map>(rooms_[index].path));
+  }
+
+  evict(nearby);
+}
+
+void World::evict(const sf::FloatRect keep) {
+  std::size_t used = 0;
+  std::vector<std::size_t> candidates;
+  for (std::size_t i = 0; i < rooms_.size(); i++) {
+    auto& room = rooms_[i];
+    if (!room.map) {
+      continue;
+    }
+    used += room.map->memoryUsage();
+    if (!room.modified && !room.bounds.intersects(keep)) {
+      candidates.push_back(i);
+    }
+  }
+
+  std::sort(candidates.begin(), candidates.end(),
+            [this](std::size_t a, std::size_t b) {
+              return rooms_[a].lastUsed < rooms_[b].lastUsed;
+            });
+  for (const auto index : candidates) {
+    if (used <= memoryBudget_) {
+      break;
+    }
+    auto& room = rooms_[index];
+    used -= std::min(used, room.map->memoryUsage());
+    room.map.reset();
+  }
+}
+
+bool World::update(const sf::Time& time) {
+  for (auto& room : rooms_) {
+    if (room.map) {
+      room.map->update(time);
+    }
+  }
+  return true;
+}
+
+void World::render(sf::RenderTarget& window, const sf::Vector2f cameraPos) {
+  const sf::FloatRect view(cameraPos.x, cameraPos.y, (float)SCREEN_WIDTH,
+                           (float)SCREEN_HEIGHT);
+  roomsIn(view, [this, &window, &cameraPos](std::size_t index) {
+    if (rooms_[index].map) {
+      rooms_[index].map->render(window, cameraPos);
+    }
+  });
+}
+
+void World::snapshot(RenderSnapshot& snapshot, const sf::Vector2f cameraPos) {
+  const sf::FloatRect view(cameraPos.x, cameraPos.y, (float)SCREEN_WIDTH,
+                           (float)SCREEN_HEIGHT);
+  roomsIn(view, [this, &snapshot, &cameraPos](std::size_t index) {
+    if (rooms_[index].map) {
+      rooms_[index].map->snapshot(snapshot, cameraPos);
+    }
+  });
+}
+
+std::size_t World::roomsLoaded() {
+  std::size_t count = 0;
+  for (const auto& room : rooms_) {
+    if (room.map) {
+      ++count;
+    }
+  }
+  return count;
+}
+
+}  // namespace map
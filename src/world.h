@@ -0,0 +1,225 @@
+#pragma once
+
+#include "map.h"
+
+#include <SFML/Graphics.hpp>
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace map {
+
+/**
+ * A map made of many room maps laid out by a Tiled world file. Rooms
+ * around the camera are loaded on a background thread and far ones are
+ * evicted least recently used first once the resident rooms go over a
+ * memory budget, so memory and load time follow the visible area rather
+ * than the world size.
+ *
+ * Queries against rooms that aren't loaded act as if they were solid: the
+ * position isn't walkable and the next tile above or below is the one the
+ * rectangle is already touching. Unloaded rooms aren't drawn. Rooms with
+ * tiles changed by setTile are never evicted so the changes aren't lost.
+ */
+class World : public Map {
+ private:
+  // Default resident budget, including tileset textures
+  static const std::size_t DEFAULT_MEMORY_BUDGET = 64 * 1024 * 1024;
+
+  // Marks no room being loaded
+  static const std::size_t NO_ROOM = (std::size_t)-1;
+
+  // Size in pixels of the cells of the grid used to find rooms by position
+  static constexpr int ROOM_GRID_PIXELS = 512;
+
+  /**
+   * A map placed in the world
+   */
+  struct Room {
+    std::string path;
+
+    // Position and size in world pixels
+    sf::FloatRect bounds;
+
+    // Null until loaded
+    std::unique_ptr<Map> map;
+
+    // Set when the room couldn't be loaded, so it isn't requested again
+    bool failed = false;
+
+    // Set once setTile changes the room
+    bool modified = false;
+
+    // Value of streamCount_ when the room was last near the camera
+    std::uint64_t lastUsed = 0;
+  };
+
+  std::vector<Room> rooms_;
+
+  // Row-major room indices overlapping each grid cell
+  std::vector<std::vector<std::size_t>> roomGrid_;
+  int gridWide_ = 0;
+  int gridHigh_ = 0;
+
+  std::size_t memoryBudget_;
+  std::uint64_t streamCount_ = 0;
+
+  // Background loading. Besides room paths, the loader only touches these.
+  std::thread loader_;
+  std::mutex loadMutex_;
+  std::condition_variable loadWake_;
+  std::deque<std::size_t> loadQueue_;
+  std::vector<std::pair<std::size_t, std::unique_ptr<Map>>> loaded_;
+  std::size_t inFlight_ = NO_ROOM;
+  bool stopping_ = false;
+
+  /**
+   * Load rooms from the queue until stopping_ is set. Runs on loader_.
+   */
+  void loaderLoop();
+
+  /**
+   * Moves rooms finished by the loader into rooms_
+   */
+  void collectLoaded();
+
+  /**
+   * Stores a freshly loaded room
+   *
+   * @param index Index of room
+   * @param room Loaded map
+   */
+  void placeRoom(const std::size_t index, std::unique_ptr<Map> room);
+
+  /**
+   * Evicts least recently used rooms outside the given area until resident
+   * rooms fit in the memory budget
+   *
+   * @param keep Area in world pixels whose rooms are kept
+   */
+  void evict(const sf::FloatRect keep);
+
+  /**
+   * Load a world from the given path
+   *
+   * @param path Path to world file
+   * @return Whether operation was successful
+   */
+  bool loadWorld(const std::string& path);
+
+  /**
+   * Calls func with each room overlapping a rectangle, once per room
+   *
+   * @param rect Rectangle in world pixels
+   * @param func Function to call with the room's index
+   */
+  void roomsIn(const sf::FloatRect rect,
+               const std::function<void(std::size_t)>& func);
+
+  /**
+   * Gets the room containing a point
+   *
+   * @param x X coordinate in world pixels
+   * @param y Y coordinate in world pixels
+   * @return Room containing the point or nullptr if there is none
+   */
+  Room* roomAt(const float x, const float y);
+
+  /**
+   * Converts a rectangle in world pixels to a room's pixels
+   *
+   * @param room Room to convert to
+   * @param rect Rectangle to convert
+   * @return Converted rectangle
+   */
+  sf::FloatRect toRoom(const Room& room, const sf::FloatRect rect) {
+    return sf::FloatRect(rect.left - room.bounds.left,
+                         rect.top - room.bounds.top, rect.width, rect.height);
+  }
+
+  /**
+   * Finds the next not walkable tile above a rectangle in one column,
+   * searching up through the rooms above
+   *
+   * @param dim Rectangle to test
+   * @param x X coordinate of column in world pixels
+   * @return Bottom of the next not walkable tile
+   */
+  float ceilingAt(const sf::FloatRect dim, const float x);
+
+  /**
+   * Finds the next not walkable tile below a rectangle in one column,
+   * searching down through the rooms below
+   *
+   * @param dim Rectangle to test
+   * @param x X coordinate of column in world pixels
+   * @return Position the rectangle would rest at on the tile
+   */
+  float floorAt(const sf::FloatRect dim, const float x);
+
+ public:
+  World(const std::string& path,
+        const std::size_t memoryBudget = DEFAULT_MEMORY_BUDGET);
+
+  ~World();
+
+  using Map::hitTiles;
+  using Map::positionWalkable;
+
+  std::set<TileId> hitTiles(const float x, const float y, const float w,
+                            const float h) override;
+
+  bool setTile(const int layer, const int x, const int y,
+               const TileId tile) override;
+
+  float positionOfTileAbove(const sf::FloatRect dim) override;
+
+  float positionOfTileBelow(const sf::FloatRect dim) override;
+
+  bool positionWalkable(const float x, const float y, const float w,
+                        const float h) override;
+
+  std::size_t memoryUsage() override;
+
+  /**
+   * Loads rooms within a screen of the camera, synchronously for rooms on
+   * screen and in the background for the rest, then evicts rooms to fit
+   * the memory budget
+   *
+   * @param cameraPos Position of camera
+   */
+  void stream(const sf::Vector2f cameraPos) override;
+
+  bool update(const sf::Time& time) override;
+
+  void render(sf::RenderTarget& window, const sf::Vector2f cameraPos) override;
+
+  void snapshot(RenderSnapshot& snapshot,
+                const sf::Vector2f cameraPos) override;
+
+  /**
+   * Gets the number of rooms currently loaded
+   *
+   * @return Number of loaded rooms
+   */
+  std::size_t roomsLoaded();
+};
+
+/**
+ * Checks whether a path names a Tiled world file rather than a single map
+ *
+ * @param path Path to check
+ * @return Whether the path ends in .world
+ */
+bool isWorldPath(const std::string& path);
+
+}  // namespace map
@@ -0,0 +1,369 @@
+#include "../src/constants.h"
+#include "../src/engine.h"
+#include "../src/log.h"
+#include "../src/map.h"
+#include "../src/physics.h"
+#include "../src/pmap.h"
+#include "../src/quadtree.h"
+#include "../src/state.h"
+#include "../src/tileset.h"
+
+#include <SFML/Graphics.hpp>
+#include <json.hpp>
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/**
+ * Microbenchmarks for the map, collision and tileset hot paths. Must be run
+ * from the repository root so assets resolve like they do for the game.
+ */
+namespace {
+
+const std::string SOURCE_MAP = "assets/maps/main.json";
+const std::vector<std::string> MAP_ASSETS = {
+    "assets/maps/city.json", "assets/maps/dialog.json",
+    "assets/maps/main.json"};
+const std::string HERO_SPRITE = "assets/sprites/hero.json";
+const std::string NPC_SPRITE = "assets/sprites/undead.json";
+
+// Map sizes in tiles and sprite counts to sweep
+const std::vector<int> MAP_SIZES = {40, 160, 640};
+const std::vector<int> SPRITE_COUNTS = {10, 100, 1000, 5000};
+
+// Number of precomputed query rectangles cycled through by each benchmark
+const std::size_t QUERY_COUNT = 256;
+
+std::string filter_;
+sf::Time minTime_ = sf::milliseconds(200);
+
+// Accumulates benchmark results so the work can't be optimized away
+volatile double sink_ = 0;
+
+/**
+ * Times func until a batch of calls takes at least minTime_ and prints the
+ * time per call
+ *
+ * @param name Benchmark name, matched against the filter
+ * @param func Function to time, returning a value to keep alive
+ */
+template <typename F>
+void bench(const std::string& name, F func) {
+  if (name.find(filter_) == std::string::npos) {
+    return;
+  }
+
+  std::size_t iterations = 1;
+  sf::Time elapsed;
+  while (true) {
+    double sink = 0;
+    sf::Clock clock;
+    for (std::size_t i = 0; i < iterations; i++) {
+      sink += static_cast<double>(func());
+    }
+    elapsed = clock.getElapsedTime();
+    sink_ = sink_ + sink;
+
+    if (elapsed >= minTime_ || iterations >= (std::size_t)1 << 30) {
+      break;
+    }
+    iterations *= 2;
+  }
+
+  const double nsPerOp = elapsed.asMicroseconds() * 1000.0 / iterations;
+  std::cout << std::left << std::setw(48) << name << std::right
+            << std::setw(14) << std::fixed << std::setprecision(1) << nsPerOp
+            << " ns/op" << std::setw(12) << iterations << " iters"
+            << std::endl;
+}
+
+/**
+ * Reads a JSON file
+ *
+ * @param path File to read
+ * @return Parsed JSON
+ */
+nlohmann::json readJson(const std::string& path) {
+  std::ifstream file(path);
+  std::stringstream data;
+  data << file.rdbuf();
+  return nlohmann::json::parse(data.str());
+}
+
+/**
+ * Writes a square map of the given size by tiling the layers of
+ * SOURCE_MAP, so larger maps keep a realistic mix of tiles
+ *
+ * @param size Width and height of the map in tiles
+ * @return Path of the written map
+ */
+std::string writeTiledMap(const int size) {
+  auto mapData = readJson(SOURCE_MAP);
+  const int width = mapData["width"].get<int>();
+  const int height = mapData["height"].get<int>();
+
+  for (auto& layer : mapData["layers"]) {
+    const auto data = layer["data"].get<std::vector<int>>();
+    std::vector<int> tiled;
+    tiled.reserve(size * size);
+    for (int y = 0; y < size; y++) {
+      for (int x = 0; x < size; x++) {
+        tiled.push_back(data[(y % height) * width + x % width]);
+      }
+    }
+    layer["data"] = tiled;
+    layer["width"] = size;
+    layer["height"] = size;
+  }
+  mapData["width"] = size;
+  mapData["height"] = size;
+
+  // The map is written to the working directory, so point the tileset
+  // images back at the assets
+  const auto sourceBase = SOURCE_MAP.substr(0, SOURCE_MAP.find_last_of("/"));
+  for (auto& tileset : mapData["tilesets"]) {
+    tileset["image"] = sourceBase + "/" + tileset["image"].get<std::string>();
+  }
+
+  const std::string path = "./portland_bench_map_" + std::to_string(size) +
+                           ".json";
+  std::ofstream out(path);
+  out << mapData.dump();
+  return path;
+}
+
+/**
+ * Generates query rectangles the size of the hero spread over a map
+ *
+ * @param pixelWidth Width of the map in pixels
+ * @param pixelHeight Height of the map in pixels
+ * @return Query rectangles
+ */
+std::vector<sf::FloatRect> queryRects(const int pixelWidth,
+                                      const int pixelHeight) {
+  std::minstd_rand random(1);
+  std::uniform_real_distribution<float> x(0.f, pixelWidth - 16.f);
+  std::uniform_real_distribution<float> y(0.f, pixelHeight - 32.f);
+
+  std::vector<sf::FloatRect> rects;
+  for (std::size_t i = 0; i < QUERY_COUNT; i++) {
+    rects.emplace_back(x(random), y(random), 16.f, 32.f);
+  }
+  return rects;
+}
+
+/**
+ * Times loading maps from Tiled JSON and from .pmap files compiled next to
+ * them
+ *
+ * @param jsonPaths Maps to load
+ */
+void benchMapLoad(const std::vector<std::string>& jsonPaths) {
+  for (const auto& path : jsonPaths) {
+    const auto compiledPath =
+        path.substr(0, path.find_last_of(".")) + ".bench.pmap";
+    if (!pmap::compile(path, compiledPath)) {
+      continue;
+    }
+
+    bench("Map::load json " + path, [&path]() {
+      map::Map loaded(path);
+      return loaded.pixelWidth();
+    });
+    bench("Map::load pmap " + path, [&compiledPath]() {
+      map::Map loaded(compiledPath);
+      return loaded.pixelWidth();
+    });
+
+    std::remove(compiledPath.c_str());
+  }
+}
+
+void benchMapQueries(const int size, const std::string& path) {
+  map::Map tileMap(path);
+  const auto rects = queryRects(tileMap.pixelWidth(), tileMap.pixelHeight());
+  const std::string suffix = " map=" + std::to_string(size);
+
+  std::size_t i = 0;
+  bench("Map::hitTiles" + suffix, [&]() {
+    return tileMap.hitTiles(rects[i++ % QUERY_COUNT]).size();
+  });
+  bench("Map::positionWalkable" + suffix, [&]() {
+    return tileMap.positionWalkable(rects[i++ % QUERY_COUNT]);
+  });
+  bench("Map::positionOfTileAbove" + suffix, [&]() {
+    return tileMap.positionOfTileAbove(rects[i++ % QUERY_COUNT]);
+  });
+  bench("Map::positionOfTileBelow" + suffix, [&]() {
+    return tileMap.positionOfTileBelow(rects[i++ % QUERY_COUNT]);
+  });
+
+  // A fast fall, crossing a few rows
+  const sf::Vector2f fall(0, (float)tileMap.tileHeight() * 4);
+  bench("Map::sweep" + suffix, [&]() {
+    return tileMap.sweep(rects[i++ % QUERY_COUNT], fall).time;
+  });
+}
+
+void benchSpriteQueries(const std::string& path) {
+  for (const int count : SPRITE_COUNTS) {
+    GameState::loadMap(path);
+    const auto& tileMap = GameState::map();
+    GameState::loadCharacter(HERO_SPRITE, 1, 1);
+
+    const int tilesWide = tileMap->pixelWidth() / tileMap->tileWidth();
+    const int tilesHigh = tileMap->pixelHeight() / tileMap->tileHeight();
+    std::minstd_rand random(2);
+    for (int n = 0; n < count; n++) {
+      GameState::addNpc(NPC_SPRITE, (float)(random() % tilesWide),
+                        (float)(random() % tilesHigh));
+    }
+
+    const auto rects = queryRects(tileMap->pixelWidth(),
+                                  tileMap->pixelHeight());
+    const std::string suffix = " sprites=" + std::to_string(count);
+
+    // The same sprites in a quadtree, to compare against the spatial hash
+    Quadtree<entities::Sprite*> tree(sf::FloatRect(
+        0, 0, (float)tileMap->pixelWidth(), (float)tileMap->pixelHeight()));
+    for (const auto& sprite : GameState::sprites()) {
+      if (sprite) {
+        tree.insert(sprite.get(), sprite->getDimensions());
+      }
+    }
+
+    std::size_t i = 0;
+    bench("SpatialHash::query" + suffix, [&]() {
+      int found = 0;
+      GameState::spriteHash().query(rects[i++ % QUERY_COUNT],
+                                    [&found](entities::Sprite*) {
+                                      ++found;
+                                      return true;
+                                    });
+      return found;
+    });
+    bench("Quadtree::query" + suffix, [&]() {
+      int found = 0;
+      tree.query(rects[i++ % QUERY_COUNT], [&found](entities::Sprite*) {
+        ++found;
+        return true;
+      });
+      return found;
+    });
+
+    bench("GameState::dispatchCollisions" + suffix, []() {
+      GameState::dispatchCollisions();
+      return 0;
+    });
+
+    // Every sprite walks back and forth across a cell boundary, the
+    // spatial hash upkeep a frame of movement costs
+    float step = (float)tileMap->tileWidth();
+    bench("Sprite::move all" + suffix, [&]() {
+      step = -step;
+      for (const auto& sprite : GameState::sprites()) {
+        if (sprite) {
+          sprite->move(step, 0);
+        }
+      }
+      return step;
+    });
+
+    // A tick of gravity and movement for the hero and every sprite
+    bench("physics::step" + suffix, []() {
+      physics::step(1);
+      return GameState::hero()->getPosition().x;
+    });
+
+    GameState::popMap();
+  }
+}
+
+void benchRenderTile() {
+  const auto mapData = readJson(SOURCE_MAP);
+  const auto& tilesetData = mapData["tilesets"][0];
+  map::Tileset tileset("assets/maps", tilesetData);
+  const auto tileCount = tilesetData["tilecount"].get<map::TileId>();
+  const auto firstGid = tilesetData["firstgid"].get<map::TileId>();
+
+  sf::RenderTexture target;
+  target.create(SCREEN_WIDTH, SCREEN_HEIGHT);
+
+  map::TileId i = 0;
+  bench("Tileset::renderTile", [&]() {
+    const map::TileId tile = firstGid + i % tileCount;
+    tileset.renderTile(target, tile, (float)(i * 16 % SCREEN_WIDTH),
+                       (float)(i / 24 * 16 % SCREEN_HEIGHT));
+    ++i;
+    return tile;
+  });
+  target.display();
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  logger::init("portland_bench.log");
+
+  bool render = false;
+
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    if (arg == "--filter" && i + 1 < argc) {
+      filter_ = argv[++i];
+    } else if (arg == "--min-time" && i + 1 < argc) {
+      minTime_ = sf::milliseconds(std::atoi(argv[++i]));
+    } else if (arg == "--render") {
+      render = true;
+    } else {
+      std::cerr << "Usage: " << argv[0]
+                << " [--filter <name>] [--min-time <ms>] [--render]"
+                << std::endl;
+      return 1;
+    }
+  }
+
+  // Rendering benchmarks need a display, everything else runs without one
+  // and without loading textures
+  if (!render && !Engine::initHeadless()) {
+    logger::error("Error loading engine");
+    return 1;
+  }
+  if (render) {
+    GameState::initApi();
+  }
+
+  std::vector<std::string> mapPaths;
+  for (const int size : MAP_SIZES) {
+    mapPaths.push_back(writeTiledMap(size));
+  }
+
+  benchMapLoad(MAP_ASSETS);
+  benchMapLoad(mapPaths);
+
+  for (std::size_t i = 0; i < MAP_SIZES.size(); i++) {
+    benchMapQueries(MAP_SIZES[i], mapPaths[i]);
+  }
+
+  // Large enough that the biggest sprite sweep isn't wall to wall
+  benchSpriteQueries(mapPaths[1]);
+
+  if (render) {
+    benchRenderTile();
+  }
+
+  for (const auto& path : mapPaths) {
+    std::remove(path.c_str());
+  }
+
+  logger::cleanup();
+
+  return 0;
+}
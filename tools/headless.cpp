@@ -0,0 +1,86 @@
+#include "../src/constants.h"
+#include "../src/engine.h"
+#include "../src/log.h"
+#include "../src/profiler.h"
+#include "../src/util.h"
+#include "../src/vfs.h"
+
+#include "../src/screens/main_screen.h"
+
+#include <SFML/System.hpp>
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+/**
+ * Runs the game simulation without a window as fast as possible and
+ * reports throughput. Must be run from the repository root so assets
+ * resolve like they do for the game.
+ */
+int main(int argc, char** argv) {
+  logger::init("portland_headless.log");
+
+  util::Tick ticks = 10000;
+  int tickRate = TICKS_PER_SECOND;
+  std::string replayPath;
+
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    if (arg == "--ticks" && i + 1 < argc) {
+      ticks = (util::Tick)std::strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--tick-rate" && i + 1 < argc) {
+      tickRate = std::atoi(argv[++i]);
+    } else if (arg == "--replay" && i + 1 < argc) {
+      replayPath = argv[++i];
+    } else if (arg == "--archive" && i + 1 < argc) {
+      if (!vfs::mount(argv[++i])) {
+        return 1;
+      }
+    } else {
+      std::cerr << "Usage: " << argv[0]
+                << " [--ticks <n>] [--tick-rate <n>] [--replay <file>]"
+                << " [--archive <file>]" << std::endl;
+      return 1;
+    }
+  }
+
+  Engine::setTickRate(tickRate);
+
+  if (!Engine::initHeadless()) {
+    logger::error("Error loading engine");
+    Engine::cleanup();
+    return 1;
+  }
+
+  // Replays bring their own tick rate
+  if (!replayPath.empty()) {
+    if (!Engine::startReplay(replayPath)) {
+      Engine::cleanup();
+      return 1;
+    }
+    tickRate = Engine::tickRate();
+  }
+
+  Engine::pushScreen(new MainScreen());
+
+  sf::Clock clock;
+  const auto ran =
+      replayPath.empty() ? Engine::runHeadless(ticks) : Engine::runReplay();
+  const float seconds = clock.getElapsedTime().asSeconds();
+
+  const float ticksPerSecond = seconds > 0 ? ran / seconds : 0;
+  std::cout << ran << " ticks in " << seconds << "s: " << ticksPerSecond
+            << " ticks/sec (" << ticksPerSecond / tickRate
+            << "x real time)" << std::endl;
+
+  profiler::dumpCsv("portland_headless_profile.csv");
+
+  Engine::cleanup();
+
+  vfs::unmount();
+
+  logger::cleanup();
+
+  return 0;
+}
@@ -0,0 +1,50 @@
+#include "../src/log.h"
+#include "../src/pmap.h"
+
+#include <iostream>
+#include <string>
+
+/**
+ * Compiles Tiled JSON maps into .pmap files that load without parsing.
+ * Each output is written next to its input unless -o is given.
+ */
+int main(int argc, char** argv) {
+  logger::init("portland_mapc.log");
+
+  std::string outPath;
+  int first = 1;
+  if (argc > 2 && std::string(argv[1]) == "-o") {
+    outPath = argv[2];
+    first = 3;
+  }
+
+  if (first >= argc || (!outPath.empty() && argc - first != 1)) {
+    std::cerr << "Usage: " << argv[0] << " [-o <out.pmap>] <map.json>..."
+              << std::endl;
+    return 1;
+  }
+
+  int failed = 0;
+  for (int i = first; i < argc; i++) {
+    const std::string path = argv[i];
+    std::string out = outPath;
+    if (out.empty()) {
+      const auto dot = path.find_last_of(".");
+      const auto slash = path.find_last_of("/");
+      const bool hasExtension = dot != std::string::npos &&
+                                (slash == std::string::npos || dot > slash);
+      out = path.substr(0, hasExtension ? dot : path.size()) + ".pmap";
+    }
+
+    if (pmap::compile(path, out)) {
+      std::cout << path << " -> " << out << std::endl;
+    } else {
+      std::cerr << "Unable to compile " << path << std::endl;
+      ++failed;
+    }
+  }
+
+  logger::cleanup();
+
+  return failed > 0 ? 1 : 0;
+}
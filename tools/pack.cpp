@@ -0,0 +1,56 @@
+#include "../src/log.h"
+#include "../src/vfs.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+/**
+ * Packs assets into one archive for vfs::mount. Paths are stored as given,
+ * so run it from the repository root with paths relative to it.
+ */
+int main(int argc, char** argv) {
+  logger::init("portland_pack.log");
+
+  std::string outPath = "portland.ppak";
+  bool decodeImages = false;
+  std::vector<std::string> paths;
+
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    if (arg == "-o" && i + 1 < argc) {
+      outPath = argv[++i];
+    } else if (arg == "--decode-images") {
+      decodeImages = true;
+    } else if (!arg.empty() && arg[0] == '-') {
+      std::cerr << "Usage: " << argv[0]
+                << " [-o <archive>] [--decode-images] [<file>...]"
+                << std::endl
+                << "Files are read from stdin, one per line, if none are given"
+                << std::endl;
+      return 1;
+    } else {
+      paths.push_back(arg);
+    }
+  }
+
+  if (paths.empty()) {
+    std::string line;
+    while (std::getline(std::cin, line)) {
+      if (!line.empty()) {
+        paths.push_back(line);
+      }
+    }
+  }
+
+  if (!vfs::pack(paths, outPath, decodeImages)) {
+    std::cerr << "Unable to write " << outPath << std::endl;
+    return 1;
+  }
+  std::cout << "Packed " << paths.size() << " files into " << outPath
+            << std::endl;
+
+  logger::cleanup();
+
+  return 0;
+}